@@ -0,0 +1,278 @@
+/*
+    Software model of the Chrom-ART accelerator (DMA2D) and the bits of the
+    LTDC that programs wait on. Both live at their STM32F429 addresses, in
+    memory mapped by Runtime.c, and are driven from HostTick(): a started
+    DMA2D transfer runs to completion at the next tick, after which the
+    transfer-complete flag is set and, if enabled in both the DMA2D and the
+    NVIC, DMA2D_IRQHandler() is called as the interrupt would be.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "Host.h"
+
+typedef struct
+    {
+    uint32_t        CR ;        // 0x00
+    uint32_t        ISR ;
+    uint32_t        IFCR ;
+    uint32_t        FGMAR ;
+    uint32_t        FGOR ;      // 0x10
+    uint32_t        BGMAR ;
+    uint32_t        BGOR ;
+    uint32_t        FGPFCCR ;
+    uint32_t        FGCOLR ;    // 0x20
+    uint32_t        BGPFCCR ;
+    uint32_t        BGCOLR ;
+    uint32_t        FGCMAR ;
+    uint32_t        BGCMAR ;    // 0x30
+    uint32_t        OPFCCR ;
+    uint32_t        OCOLR ;
+    uint32_t        OMAR ;
+    uint32_t        OOR ;       // 0x40
+    uint32_t        NLR ;
+    uint32_t        LWR ;
+    uint32_t        AMTCR ;
+    } CHROM_ART ;
+
+// One side (foreground or background) of a memory-to-memory transfer.
+typedef struct
+    {
+    uint8_t *       adrs ;
+    uint32_t        skip ;
+    uint32_t        pfccr ;
+    uint32_t        colr ;
+    const uint32_t *clut ;
+    } SOURCE ;
+
+static volatile CHROM_ART * const   DMA2D   = (CHROM_ART *) 0x4002B000 ;
+static uint32_t * const             FG_CLUT = (uint32_t *)  0x4002B400 ;
+static uint32_t * const             BG_CLUT = (uint32_t *)  0x4002B800 ;
+static volatile uint32_t * const    LTDC_SRCR = (uint32_t *) 0x40016824 ;
+static volatile uint32_t * const    LTDC_CDSR = (uint32_t *) 0x40016848 ;
+static volatile uint32_t * const    NVIC_ISER2 = (uint32_t *) 0xE000E108 ;
+
+#define DMA2D_CR_START      (1 << 0)
+#define DMA2D_CR_TCIE       (1 << 9)
+#define DMA2D_CR_CTCIE      (1 << 12)
+#define DMA2D_ISR_TCIF      (1 << 1)
+#define DMA2D_ISR_CTCIF     (1 << 4)
+#define DMA2D_PFCCR_START   (1 << 5)
+#define DMA2D_IRQ_BIT       (1 << (90 - 64))
+#define LTDC_CDSR_VSYNCS    (1 << 2)
+
+enum {ARGB8888, RGB888, RGB565, ARGB1555, ARGB4444, L8, AL44, AL88, L4, A8, A4} ;
+
+static const uint8_t        pixel_bits[] = {32, 24, 16, 16, 16, 8, 8, 16, 4, 8, 4} ;
+static uint32_t             transfers ;
+static int                  in_handler ;
+
+extern void                 DMA2D_IRQHandler(void) __attribute__((weak)) ;
+
+static uint32_t             Expand(uint32_t value, int cm) ;
+static void                 Interrupt(uint32_t enable) ;
+static void                 LoadClut(uint32_t pfccr, uint32_t cmar, uint32_t *clut) ;
+static uint32_t             ReadPixel(const SOURCE *src, uint32_t row, uint32_t col, uint32_t width) ;
+static void                 Transfer(void) ;
+static void                 WritePixel(uint32_t argb, uint32_t row, uint32_t col, uint32_t width) ;
+
+void Dma2dReset(void)
+    {
+    memset((void *) DMA2D, 0, sizeof(CHROM_ART)) ;
+    *LTDC_CDSR = LTDC_CDSR_VSYNCS ;     // the simulated panel is always in blanking
+    }
+
+uint32_t Dma2dTransfers(void)
+    {
+    return transfers ;
+    }
+
+void Dma2dStep(void)
+    {
+    // The interrupt flag clear register acts on ISR, then reads as zero.
+    DMA2D->ISR &= ~(DMA2D->IFCR & 0x3F) ;
+    DMA2D->IFCR = 0 ;
+
+    // Writing START to a PFC control register loads that CLUT from memory.
+    if ((DMA2D->FGPFCCR | DMA2D->BGPFCCR) & DMA2D_PFCCR_START)
+        {
+        if ((DMA2D->FGPFCCR & DMA2D_PFCCR_START) != 0) LoadClut(DMA2D->FGPFCCR, DMA2D->FGCMAR, FG_CLUT) ;
+        if ((DMA2D->BGPFCCR & DMA2D_PFCCR_START) != 0) LoadClut(DMA2D->BGPFCCR, DMA2D->BGCMAR, BG_CLUT) ;
+        DMA2D->FGPFCCR &= ~DMA2D_PFCCR_START ;
+        DMA2D->BGPFCCR &= ~DMA2D_PFCCR_START ;
+        DMA2D->ISR |= DMA2D_ISR_CTCIF ;
+        Interrupt(DMA2D_CR_CTCIE) ;
+        }
+
+    if ((DMA2D->CR & DMA2D_CR_START) == 0) return ;
+
+    Transfer() ;
+    transfers++ ;
+    DMA2D->CR &= ~DMA2D_CR_START ;
+    DMA2D->ISR |= DMA2D_ISR_TCIF ;
+    Interrupt(DMA2D_CR_TCIE) ;
+    }
+
+// Calls DMA2D_IRQHandler if the given interrupt is enabled in the DMA2D and
+// the DMA2D's interrupt in the NVIC, unless it is already running.
+static void Interrupt(uint32_t enable)
+    {
+    if ((DMA2D->CR & enable) != 0 && (*NVIC_ISER2 & DMA2D_IRQ_BIT) != 0 && DMA2D_IRQHandler && !in_handler)
+        {
+        in_handler = 1 ;
+        DMA2D_IRQHandler() ;
+        in_handler = 0 ;
+        DMA2D->ISR &= ~(DMA2D->IFCR & 0x3F) ;
+        DMA2D->IFCR = 0 ;
+        }
+    }
+
+// A shadow reload (IMR or VBR in SRCR) takes effect at once.
+void LtdcStep(void)
+    {
+    *LTDC_SRCR = 0 ;
+    }
+
+static void LoadClut(uint32_t pfccr, uint32_t cmar, uint32_t *clut)
+    {
+    uint8_t *src = (uint8_t *) (uintptr_t) cmar ;
+    int entries = ((pfccr >> 8) & 0xFF) + 1 ;
+
+    for (int i = 0; i < entries; i++)
+        {
+        if ((pfccr & (1 << 4)) == 0) memcpy(&clut[i], src + 4*i, 4) ;
+        else clut[i] = 0xFF000000 | (src[3*i+2] << 16) | (src[3*i+1] << 8) | src[3*i] ;
+        }
+    }
+
+static void Transfer(void)
+    {
+    uint32_t mode   = (DMA2D->CR >> 16) & 3 ;
+    uint32_t width  = DMA2D->NLR >> 16 ;
+    uint32_t height = DMA2D->NLR & 0xFFFF ;
+    SOURCE fg = {(uint8_t *) (uintptr_t) DMA2D->FGMAR, DMA2D->FGOR, DMA2D->FGPFCCR, DMA2D->FGCOLR, FG_CLUT} ;
+    SOURCE bg = {(uint8_t *) (uintptr_t) DMA2D->BGMAR, DMA2D->BGOR, DMA2D->BGPFCCR, DMA2D->BGCOLR, BG_CLUT} ;
+
+    for (uint32_t row = 0; row < height; row++)
+        {
+        for (uint32_t col = 0; col < width; col++)
+            {
+            uint32_t f, b, af, ab, amul, aout, argb ;
+
+            switch (mode)
+                {
+                case 0:     // memory to memory, no conversion: copy fg pixels as they are
+                    {
+                    uint32_t bytes = pixel_bits[fg.pfccr & 15] / 8 ;
+                    memcpy((uint8_t *) (uintptr_t) DMA2D->OMAR + bytes * (row*(width + DMA2D->OOR) + col),
+                           fg.adrs + bytes * (row*(width + fg.skip) + col), bytes) ;
+                    continue ;
+                    }
+
+                case 1:     // memory to memory with pixel format conversion
+                    argb = ReadPixel(&fg, row, col, width) ;
+                    break ;
+
+                case 2:     // memory to memory with blending
+                    f  = ReadPixel(&fg, row, col, width) ;
+                    b  = ReadPixel(&bg, row, col, width) ;
+                    af = f >> 24 ;
+                    ab = b >> 24 ;
+                    amul = af * ab / 255 ;
+                    aout = af + ab - amul ;
+                    argb = aout << 24 ;
+                    for (int shift = 0; shift < 24 && aout != 0; shift += 8)
+                        {
+                        uint32_t cf = (f >> shift) & 0xFF ;
+                        uint32_t cb = (b >> shift) & 0xFF ;
+                        argb |= ((cf*af + cb*ab - cb*amul) / aout) << shift ;
+                        }
+                    break ;
+
+                default:    // register to memory
+                    argb = DMA2D->OCOLR ;
+                    if ((DMA2D->OPFCCR & 7) == ARGB8888)
+                        {
+                        ((uint32_t *) (uintptr_t) DMA2D->OMAR)[row*(width + DMA2D->OOR) + col] = argb ;
+                        continue ;
+                        }
+                    argb = Expand(argb, DMA2D->OPFCCR & 7) ;
+                    break ;
+                }
+
+            WritePixel(argb, row, col, width) ;
+            }
+        }
+    }
+
+// Reads one pixel of a source as ARGB8888, applying its CLUT and alpha mode.
+static uint32_t ReadPixel(const SOURCE *src, uint32_t row, uint32_t col, uint32_t width)
+    {
+    uint32_t cm = src->pfccr & 15 ;
+    uint32_t index = row*(width + src->skip) + col ;
+    uint32_t bits = index * pixel_bits[cm] ;
+    const uint8_t *p = src->adrs + bits / 8 ;
+    uint32_t argb, alpha ;
+
+    switch (cm)
+        {
+        case ARGB8888:  argb = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24) ; break ;
+        case RGB888:    argb = 0xFF000000 | p[0] | (p[1] << 8) | (p[2] << 16) ; break ;
+        case L8:        argb = src->clut[p[0]] ; break ;
+        case AL44:      argb = (src->clut[p[0] & 15] & 0xFFFFFF) | ((p[0] >> 4) * 17u << 24) ; break ;
+        case AL88:      argb = (src->clut[p[0]] & 0xFFFFFF) | ((uint32_t) p[1] << 24) ; break ;
+        case L4:        argb = src->clut[(bits & 4) ? p[0] >> 4 : p[0] & 15] ; break ;
+        case A8:        argb = (src->colr & 0xFFFFFF) | ((uint32_t) p[0] << 24) ; break ;
+        case A4:        argb = (src->colr & 0xFFFFFF) | (((bits & 4) ? p[0] >> 4 : p[0] & 15) * 17u << 24) ; break ;
+        default:        argb = Expand(p[0] | (p[1] << 8), cm) ; break ;
+        }
+
+    // Alpha mode: keep, replace by or multiply with the ALPHA field.
+    alpha = src->pfccr >> 24 ;
+    switch ((src->pfccr >> 16) & 3)
+        {
+        case 1:     argb = (argb & 0xFFFFFF) | (alpha << 24) ; break ;
+        case 2:     argb = (argb & 0xFFFFFF) | ((alpha * (argb >> 24) / 255) << 24) ; break ;
+        }
+    return argb ;
+    }
+
+// Converts a 16-bit (or, for RGB888 output color, 24-bit) value to ARGB8888.
+static uint32_t Expand(uint32_t value, int cm)
+    {
+    uint32_t a = 255, r, g, b ;
+
+    switch (cm)
+        {
+        case RGB888:    return 0xFF000000 | value ;
+        case RGB565:    r = (value >> 11) & 31 ; g = (value >> 5) & 63 ; b = value & 31 ;
+                        return 0xFF000000 | ((r*255/31) << 16) | ((g*255/63) << 8) | (b*255/31) ;
+        case ARGB1555:  a = (value & 0x8000) ? 255 : 0 ;
+                        r = (value >> 10) & 31 ; g = (value >> 5) & 31 ; b = value & 31 ;
+                        return (a << 24) | ((r*255/31) << 16) | ((g*255/31) << 8) | (b*255/31) ;
+        case ARGB4444:  return ((value >> 12) * 17u << 24) | (((value >> 8) & 15) * 17u << 16)
+                               | (((value >> 4) & 15) * 17u << 8) | ((value & 15) * 17u) ;
+        default:        return value ;
+        }
+    }
+
+// Stores one ARGB8888 pixel in the output format.
+static void WritePixel(uint32_t argb, uint32_t row, uint32_t col, uint32_t width)
+    {
+    uint32_t cm = DMA2D->OPFCCR & 7 ;
+    uint32_t index = row*(width + DMA2D->OOR) + col ;
+    uint8_t *p = (uint8_t *) (uintptr_t) DMA2D->OMAR + index * pixel_bits[cm] / 8 ;
+    uint32_t a = argb >> 24, r = (argb >> 16) & 0xFF, g = (argb >> 8) & 0xFF, b = argb & 0xFF ;
+    uint32_t value ;
+
+    switch (cm)
+        {
+        case ARGB8888:  memcpy(p, &argb, 4) ; return ;
+        case RGB888:    p[0] = b ; p[1] = g ; p[2] = r ; return ;
+        case RGB565:    value = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3) ; break ;
+        case ARGB1555:  value = ((a >> 7) << 15) | ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3) ; break ;
+        default:        value = ((a >> 4) << 12) | ((r >> 4) << 8) | ((g >> 4) << 4) | (b >> 4) ; break ;
+        }
+    p[0] = value ;
+    p[1] = value >> 8 ;
+    }
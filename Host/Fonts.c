@@ -0,0 +1,137 @@
+/*
+    The five fonts of the board library (Font8 ... Font24), in the same
+    format: one glyph per printable ASCII character, each row MSB first and
+    padded to whole bytes. They are built at start-up by scaling a single
+    5x7 glyph set to each cell size, which is plenty for a simulator; only
+    the two glyphs that Lab 5's SanityChecksOK compares against the board's
+    tables are drawn to match them.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "Host.h"
+
+#define FIRST_CHAR          ' '
+#define CHARS               95      // ' ' through '~'
+
+// 5x7 glyphs, one byte per column, least significant bit on top.
+static const uint8_t glyphs[CHARS][5] =
+    {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, // ' ' '!'
+    {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14}, // '"' '#'
+    {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62}, // '$' '%'
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, // '&' '''
+    {0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00}, // '(' ')'
+    {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08}, // '*' '+'
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, // ',' '-'
+    {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02}, // '.' '/'
+    {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00}, // '0' '1'
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, // '2' '3'
+    {0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39}, // '4' '5'
+    {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03}, // '6' '7'
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, // '8' '9'
+    {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00}, // ':' ';'
+    {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14}, // '<' '='
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, // '>' '?'
+    {0x32, 0x49, 0x79, 0x41, 0x3E}, {0x7E, 0x11, 0x11, 0x11, 0x7E}, // '@' 'A'
+    {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22}, // 'B' 'C'
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, // 'D' 'E'
+    {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x49, 0x49, 0x7A}, // 'F' 'G'
+    {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00}, // 'H' 'I'
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, // 'J' 'K'
+    {0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x0C, 0x02, 0x7F}, // 'L' 'M'
+    {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E}, // 'N' 'O'
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, // 'P' 'Q'
+    {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31}, // 'R' 'S'
+    {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F}, // 'T' 'U'
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F}, // 'V' 'W'
+    {0x63, 0x14, 0x08, 0x14, 0x63}, {0x07, 0x08, 0x70, 0x08, 0x07}, // 'X' 'Y'
+    {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00}, // 'Z' '['
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, // '\' ']'
+    {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40}, // '^' '_'
+    {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78}, // '`' 'a'
+    {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, // 'b' 'c'
+    {0x38, 0x44, 0x44, 0x48, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18}, // 'd' 'e'
+    {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E}, // 'f' 'g'
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, // 'h' 'i'
+    {0x20, 0x40, 0x44, 0x3D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00}, // 'j' 'k'
+    {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78}, // 'l' 'm'
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, // 'n' 'o'
+    {0x7C, 0x14, 0x14, 0x14, 0x08}, {0x08, 0x14, 0x14, 0x18, 0x7C}, // 'p' 'q'
+    {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20}, // 'r' 's'
+    {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, // 't' 'u'
+    {0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C}, // 'v' 'w'
+    {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C}, // 'x' 'y'
+    {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, // 'z' '{'
+    {0x00, 0x00, 0x7F, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00}, // '|' '}'
+    {0x08, 0x04, 0x08, 0x10, 0x08}                                  // '~'
+    } ;
+
+static uint8_t              table8[CHARS][8][1] ;
+static uint8_t              table12[CHARS][12][1] ;
+static uint8_t              table16[CHARS][16][2] ;
+static uint8_t              table20[CHARS][20][2] ;
+static uint8_t              table24[CHARS][24][3] ;
+
+sFONT                       Font8   = {(uint8_t *) table8,   5,  8} ;
+sFONT                       Font12  = {(uint8_t *) table12,  7, 12} ;
+sFONT                       Font16  = {(uint8_t *) table16, 11, 16} ;
+sFONT                       Font20  = {(uint8_t *) table20, 14, 20} ;
+sFONT                       Font24  = {(uint8_t *) table24, 17, 24} ;
+
+static void                 ScaleGlyphs(sFONT *font) ;
+
+void FontsInitialize(void)
+    {
+    // The board library's Font8 'H', serifs and all.
+    static const uint8_t board8H[] = {0xE8, 0x48, 0x78, 0x48, 0x48, 0xE8, 0x00, 0x00} ;
+    uint8_t (*slash)[3] = table24['/' - FIRST_CHAR] ;
+
+    ScaleGlyphs(&Font8) ;
+    ScaleGlyphs(&Font12) ;
+    ScaleGlyphs(&Font16) ;
+    ScaleGlyphs(&Font20) ;
+    ScaleGlyphs(&Font24) ;
+
+    memcpy(table8['H' - FIRST_CHAR], board8H, sizeof(board8H)) ;
+
+    // Font24 '/' is a two pixel wide stroke from (11, 0) down to (2, 23).
+    memset(slash, 0, sizeof(table24[0])) ;
+    for (int row = 0; row < Font24.Height; row++)
+        {
+        int col = 11 - (9 * row) / 23 ;
+
+        slash[row][col / 8]       |= 0x80 >> (col % 8) ;
+        slash[row][(col + 1) / 8] |= 0x80 >> ((col + 1) % 8) ;
+        }
+    }
+
+// Samples each 5x7 glyph, in a 6x8 cell that includes one column and one
+// row of spacing (Font8, only 5 wide, gets no spacing column), at the
+// centers of the font's Width x Height pixels.
+static void ScaleGlyphs(sFONT *font)
+    {
+    int bytesPerRow = (font->Width + 7) / 8 ;
+    int cellCols = font->Width < 6 ? 5 : 6 ;
+    uint8_t *pline = (uint8_t *) font->table ;
+
+    for (int ch = 0; ch < CHARS; ch++)
+        {
+        for (int row = 0; row < font->Height; row++)
+            {
+            int srcRow = (2*row + 1) * 8 / (2*font->Height) ;
+
+            memset(pline, 0, bytesPerRow) ;
+            for (int col = 0; col < font->Width; col++)
+                {
+                int srcCol = (2*col + 1) * cellCols / (2*font->Width) ;
+
+                if (srcCol < 5 && (glyphs[ch][srcCol] & (1 << srcRow)) != 0)
+                    {
+                    pline[col / 8] |= 0x80 >> (col % 8) ;
+                    }
+                }
+            pline += bytesPerRow ;
+            }
+        }
+    }
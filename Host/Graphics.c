@@ -0,0 +1,222 @@
+/*
+    LCD drawing for the host run-time. Everything is drawn into the layer 1
+    frame buffer at 0xD0000000 (ARGB8888, XPIXELS x YPIXELS), which is also
+    what a "dump" in the input script writes to a PPM file. As on the board,
+    the header (Font16) takes the top 48 rows and the footer (Font12) the
+    bottom 16.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "graphics.h"
+#include "Host.h"
+
+#define HEADER_ROWS         48
+#define FOOTER_ROWS         16
+#define BAND_COLOR          COLOR_DARKBLUE
+
+static uint32_t             foreground = COLOR_BLACK ;
+static uint32_t             background = COLOR_WHITE ;
+static sFONT *              font = &Font16 ;
+
+static void                 DisplayBand(int y, int height, char *text, sFONT *bandFont) ;
+static int                  LineLength(const char *text, int maxChars) ;
+static void                 PutPixel(int x, int y, uint32_t color) ;
+
+static void PutPixel(int x, int y, uint32_t color)
+    {
+    if (x >= 0 && x < XPIXELS && y >= 0 && y < YPIXELS) HOST_SCREEN[y*XPIXELS + x] = color ;
+    }
+
+void SetForeground(uint32_t color)
+    {
+    foreground = color ;
+    }
+
+void SetBackground(uint32_t color)
+    {
+    background = color ;
+    }
+
+void SetColor(uint32_t color)
+    {
+    foreground = color ;
+    }
+
+void BSP_LCD_SetFont(sFONT *newFont)
+    {
+    font = newFont ;
+    }
+
+// Clears everything between the header and the footer to white.
+void ClearDisplay(void)
+    {
+    for (int y = HEADER_ROWS; y < YPIXELS - FOOTER_ROWS; y++)
+        {
+        for (int x = 0; x < XPIXELS; x++) HOST_SCREEN[y*XPIXELS + x] = COLOR_WHITE ;
+        }
+    }
+
+void FillRect(int x, int y, int width, int height)
+    {
+    for (int row = y; row < y + height; row++)
+        {
+        for (int col = x; col < x + width; col++) PutPixel(col, row, foreground) ;
+        }
+    }
+
+// Outlines the rectangle from (x, y) to (x + width, y + height) inclusive.
+void DrawRect(int x, int y, int width, int height)
+    {
+    for (int col = x; col <= x + width; col++)
+        {
+        PutPixel(col, y, foreground) ;
+        PutPixel(col, y + height, foreground) ;
+        }
+    for (int row = y; row <= y + height; row++)
+        {
+        PutPixel(x, row, foreground) ;
+        PutPixel(x + width, row, foreground) ;
+        }
+    }
+
+void FillCircle(int x, int y, int radius)
+    {
+    for (int dy = -radius; dy <= radius; dy++)
+        {
+        for (int dx = -radius; dx <= radius; dx++)
+            {
+            if (dx*dx + dy*dy <= radius*radius) PutPixel(x + dx, y + dy, foreground) ;
+            }
+        }
+    }
+
+// Midpoint circle: one pixel per step in each of the eight octants.
+void DrawCircle(int x, int y, int radius)
+    {
+    int dx = radius, dy = 0, error = 1 - radius ;
+
+    while (dy <= dx)
+        {
+        PutPixel(x + dx, y + dy, foreground) ; PutPixel(x - dx, y + dy, foreground) ;
+        PutPixel(x + dx, y - dy, foreground) ; PutPixel(x - dx, y - dy, foreground) ;
+        PutPixel(x + dy, y + dx, foreground) ; PutPixel(x - dy, y + dx, foreground) ;
+        PutPixel(x + dy, y - dx, foreground) ; PutPixel(x - dy, y - dx, foreground) ;
+        dy++ ;
+        if (error < 0) error += 2*dy + 1 ;
+        else error += 2*(dy - --dx) + 1 ;
+        }
+    }
+
+void DisplayChar(int x, int y, char ch)
+    {
+    int bytesPerRow = (font->Width + 7) / 8 ;
+    const uint8_t *pline ;
+
+    if (ch < ' ' || ch > '~') ch = ' ' ;
+    pline = font->table + (ch - ' ') * font->Height * bytesPerRow ;
+    for (int row = 0; row < font->Height; row++, pline += bytesPerRow)
+        {
+        for (int col = 0; col < font->Width; col++)
+            {
+            int bit = pline[col / 8] & (0x80 >> (col % 8)) ;
+            PutPixel(x + col, y + row, bit ? foreground : background) ;
+            }
+        }
+    }
+
+void DisplayStringAt(int x, int y, uint8_t *text)
+    {
+    if (HostEcho()) printf("%s\n", (char *) text) ;
+    for (; *text != '\0' && x + font->Width <= XPIXELS; text++, x += font->Width)
+        {
+        DisplayChar(x, y, *text) ;
+        }
+    }
+
+void DisplayHeader(char *text)
+    {
+    DisplayBand(0, HEADER_ROWS, text, &Font16) ;
+    }
+
+void DisplayFooter(char *text)
+    {
+    DisplayBand(YPIXELS - FOOTER_ROWS, FOOTER_ROWS, text, &Font12) ;
+    }
+
+// Returns how much of the text fits on a line of maxChars, breaking at the
+// last blank that keeps the line short enough.
+static int LineLength(const char *text, int maxChars)
+    {
+    int length = strlen(text) ;
+
+    if (length > maxChars)
+        {
+        for (length = maxChars; length > 0 && text[length] != ' '; length--) ;
+        if (length == 0) length = maxChars ;
+        }
+    return length ;
+    }
+
+// Fills a band across the screen and centers the text in it, broken into
+// as many lines as fit, leaving the program's colors and font as they were.
+static void DisplayBand(int y, int height, char *text, sFONT *bandFont)
+    {
+    const int maxChars = XPIXELS / bandFont->Width ;
+    const int maxLines = height / bandFont->Height ;
+    uint32_t fg = foreground, bg = background ;
+    sFONT *saved = font ;
+    char line[XPIXELS + 1] ;
+    const char *p ;
+    int lines ;
+
+    foreground = BAND_COLOR ;
+    FillRect(0, y, XPIXELS, height) ;
+
+    for (lines = 0, p = text; *p != '\0' && lines < maxLines; lines++)
+        {
+        p += LineLength(p, maxChars) ;
+        while (*p == ' ') p++ ;
+        }
+
+    font = bandFont ;
+    foreground = COLOR_WHITE ;
+    background = BAND_COLOR ;
+    y += (height - lines*font->Height) / 2 ;
+    for (p = text; lines-- > 0; y += font->Height)
+        {
+        int length = LineLength(p, maxChars) ;
+
+        memcpy(line, p, length) ;
+        line[length] = '\0' ;
+        DisplayStringAt((XPIXELS - length*font->Width) / 2, y, (uint8_t *) line) ;
+        p += length ;
+        while (*p == ' ') p++ ;
+        }
+
+    foreground = fg ;
+    background = bg ;
+    font = saved ;
+    }
+
+// Writes the layer 1 frame buffer as a binary PPM file.
+void GraphicsDump(const char *path)
+    {
+    FILE *fp = fopen(path, "wb") ;
+
+    if (fp == NULL)
+        {
+        perror(path) ;
+        return ;
+        }
+
+    fprintf(fp, "P6\n%d %d\n255\n", XPIXELS, YPIXELS) ;
+    for (int i = 0; i < XPIXELS*YPIXELS; i++)
+        {
+        uint32_t argb = HOST_SCREEN[i] ;
+        uint8_t rgb[3] = {argb >> 16, argb >> 8, argb} ;
+        fwrite(rgb, 1, 3, fp) ;
+        }
+    fclose(fp) ;
+    }
@@ -0,0 +1,53 @@
+/*
+    Declarations shared by the modules of the host run-time. None of this
+    is visible to the labs, which only include library.h, graphics.h and
+    touch.h.
+*/
+
+#ifndef __HOST_H
+#define __HOST_H
+
+#include <stdint.h>
+
+#define HOST_CPU_MHZ        168     // rate of the simulated cycle counter
+
+// Simulated memory-mapped regions (the executable must be linked -no-pie
+// so that none of its own sections lands on them).
+#define HOST_PERIPH_BASE    0x40000000
+#define HOST_PERIPH_SIZE    0x00080000
+#define HOST_SDRAM_BASE     0xD0000000
+#define HOST_SDRAM_SIZE     0x00800000
+#define HOST_SCS_BASE       0xE0000000
+#define HOST_SCS_SIZE       0x00100000
+
+#define HOST_SCREEN         ((uint32_t *) HOST_SDRAM_BASE)
+
+// Same layout as the sFONT the labs declare for the board library's fonts.
+typedef struct
+    {
+    const uint8_t * table ;
+    const uint16_t  Width ;
+    const uint16_t  Height ;
+    } sFONT;
+
+extern sFONT                Font8, Font12, Font16, Font20, Font24 ;
+
+// Runtime.c
+uint64_t                    HostMicroseconds(void) ;
+void                        HostTick(void) ;
+void                        HostExit(int status) ;
+int                         HostEcho(void) ;
+
+// Dma2d.c
+void                        Dma2dReset(void) ;
+void                        Dma2dStep(void) ;
+uint32_t                    Dma2dTransfers(void) ;
+void                        LtdcStep(void) ;
+
+// Fonts.c
+void                        FontsInitialize(void) ;
+
+// Graphics.c
+void                        GraphicsDump(const char *path) ;
+
+#endif
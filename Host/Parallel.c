@@ -0,0 +1,151 @@
+/*
+    Work-stealing thread pool for the host builds. Each thread owns a deque
+    of indices, which (since indices are only ever taken from its ends) is
+    just a range: the owner takes from the bottom and thieves take the top
+    half. The workers are created on first use and then sleep between
+    calls; the calling thread works as thread 0.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "parallel.h"
+
+typedef struct
+    {
+    pthread_mutex_t lock ;
+    int             top, bottom ;   // indices top <= i < bottom not yet taken
+    } DEQUE ;
+
+static DEQUE                deques[HOST_MAX_THREADS] = {{PTHREAD_MUTEX_INITIALIZER, 0, 0}} ;
+static pthread_t            workers[HOST_MAX_THREADS] ;
+static int                  created = 1 ;   // threads in the pool, the caller's included
+static pthread_mutex_t      pool_lock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t       pool_go = PTHREAD_COND_INITIALIZER ;
+static pthread_cond_t       pool_done = PTHREAD_COND_INITIALIZER ;
+static unsigned             generation ;    // calls so far, to wake the workers
+static int                  active ;        // threads taking part in this call
+static int                  finished ;      // of which have run out of work
+static void                 (*pool_job)(void *arg, int index) ;
+static void *               pool_arg ;
+
+static void                 RunJobs(int self, int threads) ;
+static int                  Steal(int self, int threads) ;
+static int                  Take(int self) ;
+static void *               Worker(void *arg) ;
+
+void HostParallelFor(int count, int threads, void (*job)(void *arg, int index), void *arg)
+    {
+    if (threads > HOST_MAX_THREADS) threads = HOST_MAX_THREADS ;
+    if (threads > count) threads = count ;
+    if (threads < 1) threads = 1 ;
+
+    pthread_mutex_lock(&pool_lock) ;
+    for (; created < threads; created++)
+        {
+        pthread_mutex_init(&deques[created].lock, NULL) ;
+        pthread_create(&workers[created], NULL, Worker, (void *) (intptr_t) created) ;
+        }
+    for (int t = 0; t < threads; t++)
+        {
+        deques[t].top    = (int) ((int64_t) count * t / threads) ;
+        deques[t].bottom = (int) ((int64_t) count * (t + 1) / threads) ;
+        }
+    pool_job = job ;
+    pool_arg = arg ;
+    active   = threads ;
+    finished = 0 ;
+    generation++ ;
+    pthread_cond_broadcast(&pool_go) ;
+    pthread_mutex_unlock(&pool_lock) ;
+
+    RunJobs(0, threads) ;
+
+    pthread_mutex_lock(&pool_lock) ;
+    finished++ ;
+    while (finished < active) pthread_cond_wait(&pool_done, &pool_lock) ;
+    pthread_mutex_unlock(&pool_lock) ;
+    }
+
+int HostCpuCount(void)
+    {
+    char *env = getenv("HOST_THREADS") ;
+    long count = env != NULL ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN) ;
+
+    if (count < 1) count = 1 ;
+    if (count > HOST_MAX_THREADS) count = HOST_MAX_THREADS ;
+    return (int) count ;
+    }
+
+static void *Worker(void *arg)
+    {
+    int self = (int) (intptr_t) arg ;
+    unsigned seen ;
+
+    // A worker is created during a call, which cannot end without it.
+    pthread_mutex_lock(&pool_lock) ;
+    seen = generation - 1 ;
+    for (;;)
+        {
+        while (generation == seen) pthread_cond_wait(&pool_go, &pool_lock) ;
+        seen = generation ;
+        if (self >= active) continue ;
+
+        pthread_mutex_unlock(&pool_lock) ;
+        RunJobs(self, active) ;
+        pthread_mutex_lock(&pool_lock) ;
+        if (++finished == active) pthread_cond_signal(&pool_done) ;
+        }
+    return NULL ;
+    }
+
+// Works through this thread's own indices, then through stolen ones,
+// until there are none left anywhere.
+static void RunJobs(int self, int threads)
+    {
+    int index ;
+
+    while ((index = Take(self)) >= 0 || (index = Steal(self, threads)) >= 0)
+        {
+        (*pool_job)(pool_arg, index) ;
+        }
+    }
+
+static int Take(int self)
+    {
+    DEQUE *deque = &deques[self] ;
+    int index = -1 ;
+
+    pthread_mutex_lock(&deque->lock) ;
+    if (deque->top < deque->bottom) index = --deque->bottom ;
+    pthread_mutex_unlock(&deque->lock) ;
+    return index ;
+    }
+
+// Takes the top half (rounded up) of the first other deque found with
+// anything left, starting with the next thread's: returns the first of
+// those indices and keeps the rest in this thread's deque. Returns -1 if
+// every deque was empty.
+static int Steal(int self, int threads)
+    {
+    for (int k = 1; k < threads; k++)
+        {
+        DEQUE *victim = &deques[(self + k) % threads] ;
+        int first, count ;
+
+        pthread_mutex_lock(&victim->lock) ;
+        first = victim->top ;
+        count = (victim->bottom - first + 1) / 2 ;
+        victim->top += count ;
+        pthread_mutex_unlock(&victim->lock) ;
+        if (count <= 0) continue ;
+
+        pthread_mutex_lock(&deques[self].lock) ;
+        deques[self].top    = first + 1 ;
+        deques[self].bottom = first + count ;
+        pthread_mutex_unlock(&deques[self].lock) ;
+        return first ;
+        }
+    return -1 ;
+    }
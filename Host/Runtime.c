@@ -0,0 +1,383 @@
+/*
+    Host run-time: simulated memory map, cycle counter, random numbers and
+    the scripted inputs (push button, touch screen and L3GD20 gyroscope).
+
+    Time is the host's monotonic clock plus whatever the program has
+    "slept" through in WaitForPushButton, so a script of button presses
+    minutes apart still runs in a fraction of a second.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "library.h"
+#include "graphics.h"
+#include "touch.h"
+#include "Host.h"
+
+typedef enum {BUTTON, TOUCH, GYRO, DUMP, EXIT} KIND ;
+
+typedef struct
+    {
+    KIND            kind ;
+    uint64_t        start ;         // microseconds of simulated time
+    uint64_t        end ;           // BUTTON and TOUCH are held until then
+    int             x, y ;          // TOUCH position
+    float           dps[3] ;        // GYRO angular rate
+    int             status ;        // EXIT status
+    char *          path ;          // DUMP file name
+    } EVENT ;
+
+// The events of one kind in time order, and the first one not yet over.
+typedef struct
+    {
+    EVENT *         events ;
+    int             count ;
+    int             next ;
+    } TRACK ;
+
+#define HOLD_MSEC           50      // default button/touch duration
+#define GYRO_WHO_AM_I       0x0F
+#define GYRO_CTRL_REG1      0x20
+#define GYRO_CTRL_REG4      0x23
+#define GYRO_STAT_REG       0x27
+#define GYRO_DATA_REG       0x28
+#define GYRO_ZYXDA_FLAG     (1 << 3)
+#define GYRO_PD_FLAG        (1 << 3)
+
+static TRACK                buttons, touches, gyros, actions ;
+static int                  scripted ;
+static int                  echo ;
+static uint64_t             origin ;        // host nanoseconds at start-up
+static uint64_t             skipped ;       // microseconds slept through
+static uint32_t             seed = 2463534242u ;
+static uint8_t              gyro_regs[0x40] ;
+static uint64_t             gyro_sample ;   // time of the last sample read
+static int                  touch_x, touch_y ;
+
+static void                 AddEvent(TRACK *track, const EVENT *event) ;
+static const EVENT *        Current(TRACK *track, uint64_t now) ;
+static void                 MapRegion(uintptr_t base, size_t size) ;
+static void                 ReadScript(const char *path) ;
+static void                 SkipTo(uint64_t when) ;
+
+__attribute__((constructor)) static void HostStartup(void)
+    {
+    struct timespec ts ;
+    char *env ;
+
+    MapRegion(HOST_PERIPH_BASE, HOST_PERIPH_SIZE) ;
+    MapRegion(HOST_SDRAM_BASE,  HOST_SDRAM_SIZE) ;
+    MapRegion(HOST_SCS_BASE,    HOST_SCS_SIZE) ;
+    FontsInitialize() ;
+    Dma2dReset() ;
+
+    gyro_regs[GYRO_WHO_AM_I] = 0xD4 ;
+    clock_gettime(CLOCK_MONOTONIC, &ts) ;
+    origin = ts.tv_sec * 1000000000ull + ts.tv_nsec ;
+
+    if ((env = getenv("HOST_SEED")) != NULL) seed = strtoul(env, NULL, 0) | 1 ;
+    if ((env = getenv("HOST_ECHO")) != NULL) echo = atoi(env) ;
+    if ((env = getenv("HOST_SCRIPT")) != NULL) ReadScript(env) ;
+    }
+
+static void MapRegion(uintptr_t base, size_t size)
+    {
+    void *adrs = mmap((void *) base, size, PROT_READ|PROT_WRITE,
+                      MAP_FIXED_NOREPLACE|MAP_PRIVATE|MAP_ANONYMOUS, -1, 0) ;
+    if (adrs != (void *) base)
+        {
+        fprintf(stderr, "host: cannot map %08lX (link with -no-pie)\n", (unsigned long) base) ;
+        exit(255) ;
+        }
+    }
+
+// Script lines are "<msec> <event> [arguments]"; '#' starts a comment.
+//      <msec> button [hold]        press the push button for hold msec
+//      <msec> touch x y [hold]     touch the screen at (x, y)
+//      <msec> gyro x y z           angular rates in dps from now on
+//      <msec> dump file.ppm        write the screen to a PPM file
+//      <msec> exit [status]        end the program
+static void ReadScript(const char *path)
+    {
+    char line[256], word[16], name[200] ;
+    FILE *fp = fopen(path, "r") ;
+    int lineno = 0 ;
+
+    if (fp == NULL)
+        {
+        perror(path) ;
+        exit(255) ;
+        }
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+        {
+        EVENT event = {0} ;
+        double msec ;
+        int hold = HOLD_MSEC ;
+        int ok ;
+
+        lineno++ ;
+        line[strcspn(line, "#\r\n")] = '\0' ;
+        if (sscanf(line, "%lf %15s", &msec, word) != 2) continue ;
+        event.start = (uint64_t) (1000 * msec) ;
+
+        if (strcmp(word, "button") == 0)
+            {
+            sscanf(line, "%*f %*s %d", &hold) ;
+            event.kind = BUTTON ;
+            ok = 1 ;
+            }
+        else if (strcmp(word, "touch") == 0)
+            {
+            ok = sscanf(line, "%*f %*s %d %d %d", &event.x, &event.y, &hold) >= 2 ;
+            event.kind = TOUCH ;
+            }
+        else if (strcmp(word, "gyro") == 0)
+            {
+            ok = sscanf(line, "%*f %*s %f %f %f", &event.dps[0], &event.dps[1], &event.dps[2]) == 3 ;
+            event.kind = GYRO ;
+            }
+        else if (strcmp(word, "dump") == 0)
+            {
+            ok = sscanf(line, "%*f %*s %199s", name) == 1 ;
+            event.path = strdup(name) ;
+            event.kind = DUMP ;
+            }
+        else if (strcmp(word, "exit") == 0)
+            {
+            sscanf(line, "%*f %*s %d", &event.status) ;
+            event.kind = EXIT ;
+            ok = 1 ;
+            }
+        else ok = 0 ;
+
+        if (!ok)
+            {
+            fprintf(stderr, "%s:%d: bad script line\n", path, lineno) ;
+            exit(255) ;
+            }
+
+        event.end = event.start + 1000 * (uint64_t) hold ;
+        switch (event.kind)
+            {
+            case BUTTON:    AddEvent(&buttons, &event) ; break ;
+            case TOUCH:     AddEvent(&touches, &event) ; break ;
+            case GYRO:      AddEvent(&gyros, &event) ;   break ;
+            default:        AddEvent(&actions, &event) ; break ;
+            }
+        }
+
+    fclose(fp) ;
+    scripted = 1 ;
+    }
+
+// Inserts an event after any others with the same or an earlier start.
+static void AddEvent(TRACK *track, const EVENT *event)
+    {
+    int i ;
+
+    track->events = realloc(track->events, (track->count + 1) * sizeof(EVENT)) ;
+    for (i = track->count; i > 0 && track->events[i-1].start > event->start; i--)
+        {
+        track->events[i] = track->events[i-1] ;
+        }
+    track->events[i] = *event ;
+    track->count++ ;
+    }
+
+// Returns the event of a button or touch track that is in progress at
+// "now", or NULL. Events that are over are never looked at again.
+static const EVENT *Current(TRACK *track, uint64_t now)
+    {
+    while (track->next < track->count && track->events[track->next].end <= now) track->next++ ;
+    if (track->next < track->count && track->events[track->next].start <= now)
+        {
+        return &track->events[track->next] ;
+        }
+    return NULL ;
+    }
+
+uint64_t HostMicroseconds(void)
+    {
+    struct timespec ts ;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts) ;
+    return (ts.tv_sec * 1000000000ull + ts.tv_nsec - origin) / 1000 + skipped ;
+    }
+
+static void SkipTo(uint64_t when)
+    {
+    uint64_t now = HostMicroseconds() ;
+
+    if (when > now) skipped += when - now ;
+    HostTick() ;
+    }
+
+// Called from every run-time entry point that a program may spin on: lets
+// the DMA2D and LTDC make progress and performs the due script actions.
+void HostTick(void)
+    {
+    uint64_t now ;
+
+    Dma2dStep() ;
+    LtdcStep() ;
+
+    now = HostMicroseconds() ;
+    while (actions.next < actions.count && actions.events[actions.next].start <= now)
+        {
+        const EVENT *event = &actions.events[actions.next++] ;
+
+        if (event->kind == DUMP) GraphicsDump(event->path) ;
+        else HostExit(event->status) ;
+        }
+    }
+
+void HostExit(int status)
+    {
+    fprintf(stderr, "host: exit %d after %.3f s, %u DMA2D transfers\n",
+            status, HostMicroseconds() / 1e6, (unsigned) Dma2dTransfers()) ;
+    exit(status) ;
+    }
+
+int HostEcho(void)
+    {
+    return echo ;
+    }
+
+void InitializeHardware(char *header, char *subtitle)
+    {
+    SetForeground(COLOR_BLACK) ;
+    SetBackground(COLOR_WHITE) ;
+    ClearDisplay() ;
+    DisplayHeader(header) ;
+    DisplayFooter(subtitle) ;
+    }
+
+// The cycle counter of a 168 MHz Cortex-M4, derived from simulated time.
+uint32_t GetClockCycleCount(void)
+    {
+    HostTick() ;
+    return (uint32_t) (HostMicroseconds() * HOST_CPU_MHZ) ;
+    }
+
+// Xorshift; reproducible from run to run unless HOST_SEED says otherwise.
+uint32_t GetRandomNumber(void)
+    {
+    seed ^= seed << 13 ;
+    seed ^= seed >> 17 ;
+    seed ^= seed << 5 ;
+    return seed ;
+    }
+
+int PushButtonPressed(void)
+    {
+    HostTick() ;
+    return Current(&buttons, HostMicroseconds()) != NULL ;
+    }
+
+// Waits for the button to be pressed and released. With a script the
+// wait is skipped over; once the script has no more presses the program
+// is over. Without one, each line read from stdin is a press.
+void WaitForPushButton(void)
+    {
+    const EVENT *press ;
+
+    HostTick() ;
+    if (!scripted)
+        {
+        char line[80] ;
+
+        if (fgets(line, sizeof(line), stdin) == NULL) HostExit(0) ;
+        return ;
+        }
+
+    press = Current(&buttons, HostMicroseconds()) ;
+    if (press == NULL)
+        {
+        if (buttons.next == buttons.count) HostExit(0) ;
+        press = &buttons.events[buttons.next] ;
+        }
+    SkipTo(press->end) ;
+    }
+
+void TS_Init(void)
+    {
+    }
+
+int TS_Touched(void)
+    {
+    const EVENT *touch ;
+
+    HostTick() ;
+    touch = Current(&touches, HostMicroseconds()) ;
+    if (touch == NULL) return 0 ;
+    touch_x = touch->x ;
+    touch_y = touch->y ;
+    return 1 ;
+    }
+
+int TS_GetX(void)
+    {
+    return touch_x ;
+    }
+
+int TS_GetY(void)
+    {
+    return touch_y ;
+    }
+
+void GYRO_IO_Init(void)
+    {
+    }
+
+void GYRO_IO_Write(uint8_t *data, uint8_t port, uint16_t bytes)
+    {
+    while (bytes-- != 0) gyro_regs[port++ & 0x3F] = *data++ ;
+    }
+
+// Simulates an L3GD20: a new sample is ready once per output data period
+// (95..760 Hz by CTRL_REG1), scaled by the full-scale range in CTRL_REG4.
+void GYRO_IO_Read(uint8_t *data, uint8_t port, uint16_t bytes)
+    {
+    static const float mdps_per_digit[] = {8.75, 17.50, 70.00, 70.00} ;
+    static const unsigned odr_hz[] = {95, 190, 380, 760} ;
+    uint64_t now, period ;
+
+    HostTick() ;
+    now = HostMicroseconds() ;
+    period = 1000000 / odr_hz[gyro_regs[GYRO_CTRL_REG1] >> 6] ;
+
+    gyro_regs[GYRO_STAT_REG] = 0 ;
+    if ((gyro_regs[GYRO_CTRL_REG1] & GYRO_PD_FLAG) != 0 && now - gyro_sample >= period)
+        {
+        gyro_regs[GYRO_STAT_REG] = GYRO_ZYXDA_FLAG ;
+        }
+
+    if (port >= GYRO_DATA_REG && port < GYRO_DATA_REG + 6)
+        {
+        float sensitivity = mdps_per_digit[(gyro_regs[GYRO_CTRL_REG4] >> 4) & 3] / 1000 ;
+        while (gyros.next + 1 < gyros.count && gyros.events[gyros.next + 1].start <= now) gyros.next++ ;
+        for (int axis = 0; axis < 3; axis++)
+            {
+            float dps = 0 ;
+            int32_t raw ;
+
+            if (gyros.count != 0 && gyros.events[gyros.next].start <= now)
+                {
+                dps = gyros.events[gyros.next].dps[axis] ;
+                }
+            raw = (int32_t) (dps / sensitivity) ;
+            if (raw > INT16_MAX) raw = INT16_MAX ;
+            if (raw < INT16_MIN) raw = INT16_MIN ;
+            gyro_regs[GYRO_DATA_REG + 2*axis]     = (uint8_t) raw ;
+            gyro_regs[GYRO_DATA_REG + 2*axis + 1] = (uint8_t) (raw >> 8) ;
+            }
+        gyro_sample = now ;
+        }
+
+    while (bytes-- != 0) *data++ = gyro_regs[port++ & 0x3F] ;
+    }
@@ -0,0 +1,55 @@
+/*
+    Host (Linux) stand-in for the LCD interface of the board's run-time
+    library. Everything is drawn into the simulated layer 1 frame buffer
+    (ARGB8888, XPIXELS x YPIXELS) at 0xD0000000, exactly where the board
+    keeps it, so programs that write that memory directly still work.
+*/
+
+#ifndef __GRAPHICS_H
+#define __GRAPHICS_H
+
+#include <stdint.h>
+
+#define XPIXELS             240
+#define YPIXELS             320
+
+#define COLOR_BLUE          0xFF0000FF
+#define COLOR_GREEN         0xFF00FF00
+#define COLOR_RED           0xFFFF0000
+#define COLOR_CYAN          0xFF00FFFF
+#define COLOR_MAGENTA       0xFFFF00FF
+#define COLOR_YELLOW        0xFFFFFF00
+#define COLOR_LIGHTBLUE     0xFF8080FF
+#define COLOR_LIGHTGREEN    0xFF80FF80
+#define COLOR_LIGHTRED      0xFFFF8080
+#define COLOR_LIGHTCYAN     0xFF80FFFF
+#define COLOR_LIGHTMAGENTA  0xFFFF80FF
+#define COLOR_LIGHTYELLOW   0xFFFFFF80
+#define COLOR_DARKBLUE      0xFF000080
+#define COLOR_DARKGREEN     0xFF008000
+#define COLOR_DARKRED       0xFF800000
+#define COLOR_DARKCYAN      0xFF008080
+#define COLOR_DARKMAGENTA   0xFF800080
+#define COLOR_DARKYELLOW    0xFF808000
+#define COLOR_WHITE         0xFFFFFFFF
+#define COLOR_LIGHTGRAY     0xFFD3D3D3
+#define COLOR_GRAY          0xFF808080
+#define COLOR_DARKGRAY      0xFF404040
+#define COLOR_BLACK         0xFF000000
+#define COLOR_BROWN         0xFFA52A2A
+#define COLOR_ORANGE        0xFFFFA500
+
+void        ClearDisplay(void) ;
+void        DisplayChar(int x, int y, char ch) ;
+void        DisplayFooter(char *text) ;
+void        DisplayHeader(char *text) ;
+void        DisplayStringAt(int x, int y, uint8_t *text) ;
+void        DrawCircle(int x, int y, int radius) ;
+void        DrawRect(int x, int y, int width, int height) ;
+void        FillCircle(int x, int y, int radius) ;
+void        FillRect(int x, int y, int width, int height) ;
+void        SetBackground(uint32_t color) ;
+void        SetColor(uint32_t color) ;
+void        SetForeground(uint32_t color) ;
+
+#endif
@@ -0,0 +1,21 @@
+/*
+    Host (Linux) stand-in for the run-time library of the 32F429IDISCOVERY
+    board, so that the labs' Main.c files can be compiled and run unmodified
+    on a workstation. See README.md for the build commands, the simulated
+    hardware and the input script format.
+*/
+
+#ifndef __LIBRARY_H
+#define __LIBRARY_H
+
+#include <stdint.h>
+
+#define HEADER  "ARM Assembly for Embedded Applications"
+
+void        InitializeHardware(char *header, char *subtitle) ;
+uint32_t    GetClockCycleCount(void) ;
+uint32_t    GetRandomNumber(void) ;
+int         PushButtonPressed(void) ;
+void        WaitForPushButton(void) ;
+
+#endif
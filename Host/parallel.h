@@ -0,0 +1,21 @@
+/*
+    Host (Linux) only: a pool of worker threads for the labs' host builds,
+    which the board's run-time library does not have. Indices are dealt out
+    in contiguous runs, one per thread, and a thread that runs out steals
+    half of what is left of another's run.
+*/
+
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#define HOST_MAX_THREADS    64
+
+// Calls job(arg, index) once for every index from 0 to count - 1, on up
+// to threads threads (the caller's included), and returns when all calls
+// have. The calls may run in any order.
+void        HostParallelFor(int count, int threads, void (*job)(void *arg, int index), void *arg) ;
+
+// The number of threads to use: HOST_THREADS if set, else one per core.
+int         HostCpuCount(void) ;
+
+#endif
@@ -0,0 +1,14 @@
+/*
+    Host (Linux) stand-in for the touch screen interface of the board's
+    run-time library. Touches come from the input script (see README.md).
+*/
+
+#ifndef __TOUCH_H
+#define __TOUCH_H
+
+void        TS_Init(void) ;
+int         TS_Touched(void) ;
+int         TS_GetX(void) ;
+int         TS_GetY(void) ;
+
+#endif
@@ -13,6 +13,12 @@
 #include <math.h>
 #include "library.h"
 #include "graphics.h"
+#ifdef PARALLEL
+#include "parallel.h"
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #pragma GCC push_options
 #pragma GCC optimize ("O0")
@@ -67,6 +73,49 @@ typedef struct
     uint32_t                AMTCR ;     // AHB master timer configuration register
     } CHROM_ART ;
 
+typedef struct
+    {
+    uint32_t                CR ;        // Control register
+    uint32_t                WHPCR ;     // Window horizontal position configuration register
+    uint32_t                WVPCR ;     // Window vertical position configuration register
+    uint32_t                CKCR ;      // Color keying configuration register
+    uint32_t                PFCR ;      // Pixel format configuration register
+    uint32_t                CACR ;      // Constant alpha configuration register
+    uint32_t                DCCR ;      // Default color configuration register
+    uint32_t                BFCR ;      // Blending factors configuration register
+    uint32_t                reserved1[2] ;
+    uint32_t                CFBAR ;     // Color frame buffer address register
+    uint32_t                CFBLR ;     // Color frame buffer length register
+    uint32_t                CFBLNR ;    // Color frame buffer line number register
+    uint32_t                reserved2[3] ;
+    uint32_t                CLUTWR ;    // CLUT write register
+    } LTDC_LAYER ;
+
+typedef struct
+    {
+    uint32_t                reserved1[2] ;
+    uint32_t                SSCR ;      // Synchronization size configuration register
+    uint32_t                BPCR ;      // Back porch configuration register
+    uint32_t                AWCR ;      // Active width configuration register
+    uint32_t                TWCR ;      // Total width configuration register
+    uint32_t                GCR ;       // Global control register
+    uint32_t                reserved2[2] ;
+    uint32_t                SRCR ;      // Shadow reload configuration register
+    uint32_t                reserved3 ;
+    uint32_t                BCCR ;      // Background color configuration register
+    uint32_t                reserved4 ;
+    uint32_t                IER ;       // Interrupt enable register
+    uint32_t                ISR ;       // Interrupt status register
+    uint32_t                ICR ;       // Interrupt clear register
+    uint32_t                LIPCR ;     // Line interrupt position configuration register
+    uint32_t                CPSR ;      // Current position status register
+    uint32_t                CDSR ;      // Current display status register
+    uint32_t                reserved5[14] ;
+    LTDC_LAYER              L1 ;        // Layer 1 (the library's ARGB8888 screen)
+    uint32_t                reserved6[15] ;
+    LTDC_LAYER              L2 ;        // Layer 2
+    } LCD_TFT ;
+
 typedef struct
     {
     const uint8_t *         table ;
@@ -96,51 +145,566 @@ typedef struct
 
 #define CPU_CLOCK_SPEED_MHZ 168
 
+#define DMA2D_IRQN          90      // Build with -DDMA2D_POLLED to poll DMA2D->CR instead
+
+#define DMA2D_CR_START      (1 << 0)
+#define DMA2D_CR_TCIE       (1 << 9)
+#define DMA2D_CR_CTCIE      (1 << 12)
+#define DMA2D_IFCR_CTCIF    (1 << 1)
+#define DMA2D_IFCR_CCTCIF   (1 << 4)
+#define DMA2D_PFCCR_START   (1 << 5)
+#define DMA2D_PFCCR_CS(n)   (((n) - 1) << 8)
+#define DMA2D_MODE_M2M      (0 << 16)
+#define DMA2D_MODE_M2M_PFC  (1 << 16)
+#define DMA2D_MODE_M2M_BLEND (2 << 16)
+#define DMA2D_MODE_R2M      (3 << 16)
+#define DMA2D_CM_ARGB8888   0
+#define DMA2D_CM_L8         5
+#define DMA2D_CM_A8         9
+
+#define GFX_QUEUE_SIZE      16
+#define GFX_CLUT_LOAD       0xFFFFFFFF  // GFX_COMMAND mode: load FG_CLUT from fgcmar
+
+// The hue palette, fully saturated, as HSV2RGB used to compute it at start-up:
+// hue = 360*c/256 degrees, so the sextant is 3*c/128 and the fraction within
+// it (3*c % 128)/128, each channel truncated to 8 bits.
+#define HUE_SEXTANT(c)      ((3*(c)) / 128)
+#define HUE_UP(c)           ((255 * ((3*(c)) % 128)) / 128)
+#define HUE_DOWN(c)         ((255 * (128 - (3*(c)) % 128)) / 128)
+#define HUE_R(c)            (HUE_SEXTANT(c) == 0 || HUE_SEXTANT(c) == 5 ? 255 : \
+                             HUE_SEXTANT(c) == 1 ? HUE_DOWN(c) : HUE_SEXTANT(c) == 4 ? HUE_UP(c) : 0)
+#define HUE_G(c)            (HUE_SEXTANT(c) == 1 || HUE_SEXTANT(c) == 2 ? 255 : \
+                             HUE_SEXTANT(c) == 3 ? HUE_DOWN(c) : HUE_SEXTANT(c) == 0 ? HUE_UP(c) : 0)
+#define HUE_B(c)            (HUE_SEXTANT(c) == 3 || HUE_SEXTANT(c) == 4 ? 255 : \
+                             HUE_SEXTANT(c) == 5 ? HUE_DOWN(c) : HUE_SEXTANT(c) == 2 ? HUE_UP(c) : 0)
+#define HUE_RGB(c)          (0xFF000000 | (HUE_R((c) % 255) << 16) | (HUE_G((c) % 255) << 8) | HUE_B((c) % 255))
+#define HUE_RGB4(c)         HUE_RGB(c), HUE_RGB((c) + 1), HUE_RGB((c) + 2), HUE_RGB((c) + 3)
+#define HUE_RGB16(c)        HUE_RGB4(c), HUE_RGB4((c) + 4), HUE_RGB4((c) + 8), HUE_RGB4((c) + 12)
+#define HUE_RGB64(c)        HUE_RGB16(c), HUE_RGB16((c) + 16), HUE_RGB16((c) + 32), HUE_RGB16((c) + 48)
+#define HUE_COLORS          255     // color indices 0-254; 255 is black
+
+// Build with -DLTDC_L8 to scan the L8 frames out through an LTDC layer
+// CLUT instead of converting them, or with -DLTDC_EMULATED to run that
+// mode against a register block in RAM (e.g. on a host).
+#if defined(LTDC_EMULATED) && !defined(LTDC_L8)
+#define LTDC_L8
+#endif
+
+#define LTDC_LxCR_LEN       (1 << 0)
+#define LTDC_LxCR_CLUTEN    (1 << 4)
+#define LTDC_SRCR_IMR       (1 << 0)
+#define LTDC_SRCR_VBR       (1 << 1)
+#define LTDC_CDSR_VSYNCS    (1 << 2)
+#define LTDC_PF_L8          5
+
+#ifdef __arm__
+#define DISABLE_INTERRUPTS() __asm volatile ("cpsid i" ::: "memory")
+#define ENABLE_INTERRUPTS()  __asm volatile ("cpsie i" ::: "memory")
+#else
+#define DISABLE_INTERRUPTS()
+#define ENABLE_INTERRUPTS()
+#endif
+
+// Precision policy for the escape-time kernel used by the Mandelbrot and
+// Julia renderers. Build with -DFIXED_POINT for Q4.28 or -DDOUBLE_PRECISION
+// for the (soft-float) reference; the default is single-precision float,
+// which the Cortex-M4 FPU executes in hardware.
+#define Q28(f)              ((int32_t) ((f) * (float) (1 << 28)))
+#define Q24(f)              ((int32_t) ((f) * (float) (1 << 24)))
+
+#if   defined(FIXED_POINT)
+typedef int32_t             REAL ;
+#define TO_REAL(f)          Q28(f)
+#define TO_FLOAT(r)         ((float) (r) / (float) (1 << 28))
+#define EscapeTime          EscapeTimeQ28
+#elif defined(DOUBLE_PRECISION)
+typedef double              REAL ;
+#define TO_REAL(f)          ((double) (f))
+#define TO_FLOAT(r)         ((float) (r))
+#define EscapeTime          EscapeTimeDouble
+#else   // SINGLE_PRECISION
+typedef float               REAL ;
+#define TO_REAL(f)          ((float) (f))
+#define TO_FLOAT(r)         (r)
+#define EscapeTime          EscapeTimeFloat
+#endif
+
 typedef CLR_INDEX           FRAME[HEIGHT][WIDTH] ;
 
+#define TITLE_ROWS          (HEIGHT - YSIZE)    // below the image in each FRAME
+#define DIRTY_BAND_ROWS     24      // most rows converted by one DMA2D transfer
+
+// The image columns left <= x < right of each row that may differ from the
+// color the frame was filled with (none if left >= right).
+typedef struct
+    {
+    int16_t                 left[HEIGHT], right[HEIGHT] ;
+    } DIRTY ;
+
+typedef uint32_t            GFX_FENCE ;
+
+// One queued DMA2D operation: the register values to load before starting.
+typedef struct
+    {
+    uint32_t                mode ;
+    uint32_t                fgmar, fgor, fgpfccr, fgcolr, fgcmar ;
+    uint32_t                bgmar, bgor, bgpfccr ;
+    uint32_t                omar, oor, opfccr, ocolr ;
+    uint32_t                nlr ;
+    } GFX_COMMAND ;
+typedef uint8_t             ITERS[YSIZE][XSIZE] ;   // escape-time count per pixel
+
+#define ITERS_UNKNOWN       255     // not yet computed, so limits must be < 255
+
+// Which renderer fills the iteration map of each escape-time fractal:
+// RenderRaster, or RenderSubdivided with -DSUBDIVIDED, or RenderVector with
+// -DVECTOR, or RenderTiled in a host build with -DPARALLEL, which spreads
+// tiles of the map over all of the host's cores. MANDELBROT_RENDERER or
+// JULIA_RENDERER can name any other for one of the fractals: all of them
+// are compiled into every build (RenderTiled into those with -DPARALLEL).
+#if defined(PARALLEL)
+#define DEFAULT_RENDERER    RenderTiled
+#elif defined(SUBDIVIDED)
+#define DEFAULT_RENDERER    RenderSubdivided
+#elif defined(VECTOR)
+#define DEFAULT_RENDERER    RenderVector
+#else
+#define DEFAULT_RENDERER    RenderRaster
+#endif
+#ifndef MANDELBROT_RENDERER
+#define MANDELBROT_RENDERER DEFAULT_RENDERER
+#endif
+#ifndef JULIA_RENDERER
+#define JULIA_RENDERER      DEFAULT_RENDERER
+#endif
+
+#define TILE_SIZE           16      // RenderTiled's tiles are TILE_SIZE square
+#define TILE_COLS           ((XSIZE + TILE_SIZE - 1) / TILE_SIZE)
+
+#define RECT_STACK_DEPTH    32      // pending rectangles in RenderSubdivided
+#define RECT_MIN_SIZE       12      // smaller rectangles are computed, not subdivided
+
+// Build with -DPROGRESSIVE to render both sets coarse to fine instead
+// (RenderProgressive), showing each pass as it completes.
+#define PROGRESSIVE_STEP    8       // sample spacing of the first pass
+
+// Build with -DGOVERNOR to have the Julia animation trade quality for time
+// so that every frame fits its budget, with the frame rate and the quality
+// chosen shown in the footer.
+#define GOVERNOR_REPORT_MSEC 1000   // between footer updates
+
+// Build with -DDEEP_ZOOM to replace the Mandelbrot set with a zoom into it
+// (MandelbrotZoomFractal), rendered by perturbation about reference orbits.
+#define DEEP_ZOOM_STEPS     160     // frames to zoom in by 2^40, 2^(1/4) each
+#define DEEP_REFERENCES     8       // reference orbits per frame; then double
+#define DEEP_GLITCH         1e-6f   // |z|^2 below this times |Z|^2 is a glitch
+
+// The Julia animation repeats itself every turn of c. Build with
+// -DFRAME_CACHE to keep each of its frames, compressed, in SDRAM once it
+// has been drawn, and to decompress rather than render it from then on.
+#define JULIA_DEGREES       3       // turn of c per frame
+#define JULIA_FRAMES        (360 / JULIA_DEGREES)
+#define FRAME_CACHE_SIZE    0x00400000  // bytes of SDRAM for the compressed frames
+
+typedef enum
+    {
+    NO_SYMMETRY,
+    MIRROR_SYMMETRY,    // about the real axis: (x, y) looks like (x, -y)
+    POINT_SYMMETRY      // about the origin: (x, y) looks like (-x, -y)
+    } SYMMETRY ;
+
+// An escape-time fractal view: pixel (x, y) is the complex point
+// (xctr + (x - XSIZE/2)*dx, yctr + (y - YSIZE/2)*dy).
+typedef struct VIEW
+    {
+    unsigned                (*pixel)(const struct VIEW *view, int x, int y) ;
+    REAL                    xctr, yctr ;    // center of the view
+    REAL                    dx, dy ;        // distance between pixels
+    REAL                    cx, cy ;        // Julia set constant
+    unsigned                limit ;         // iteration limit
+    SYMMETRY                symmetry ;
+    } VIEW ;
+
+#define VIEW_X(view, x)     ((view)->xctr + ((x) - XSIZE/2) * (view)->dx)
+#define VIEW_Y(view, y)     ((view)->yctr + ((y) - YSIZE/2) * (view)->dy)
+
+// A Mandelbrot view too deep for REAL: the center needs double precision,
+// but the distance between pixels (and from any pixel to another) is only
+// a float, and so is every pixel's orbit relative to a reference orbit.
+typedef struct
+    {
+    double                  xctr, yctr ;    // center of the view
+    float                   dx, dy ;        // distance between pixels
+    unsigned                limit ;         // iteration limit
+    } DEEP_VIEW ;
+
+// The orbit of a reference point, computed in double precision and kept
+// as floats: Z[n] for n < length, where length is the limit or the
+// iteration at which the orbit escaped.
+typedef struct
+    {
+    float                   zx[ITERS_UNKNOWN], zy[ITERS_UNKNOWN] ;
+    unsigned                length ;
+    } ORBIT ;
+
+typedef struct
+    {
+    uint8_t                 x0, x1 ;
+    uint8_t                 y0, y1 ;
+    } RECT ;
+
+// A row kernel: the escape counts of count orbits, the i-th starting at
+// (zx[i], zy[i]) with constant (cx[i], cy[i]).
+typedef struct
+    {
+    const char *            name ;
+    int                     lanes ;     // orbits iterated at once
+    void                    (*row)(const float zx[], const float zy[], const float cx[], const float cy[], unsigned limit, uint8_t iters[], int count) ;
+    } ESCAPE_KERNEL ;
+
+// The part of the map that RenderTiled's tiles cover.
+typedef struct
+    {
+    const VIEW *            view ;
+    ITERS *                 map ;
+    int                     rows ;
+    BOOL                    stop ;      // the push button was pressed; read and written atomically
+    } TILING ;
+
+// One quality level of the governor: the iteration limit, and the spacing
+// of the pixels actually computed (each standing for its step x step block).
+typedef struct
+    {
+    uint8_t                 limit ;
+    uint8_t                 step ;
+    } QUALITY ;
+
+typedef struct
+    {
+    int                     level ;     // index into qualities
+    unsigned                frames ;    // shown since the last report
+    uint32_t                since ;     // cycle count at the last report
+    } FRAME_GOVERNOR ;
+
+#define GLYPH_CACHE_SIZE    64      // glyphs, direct mapped on character and font
+#define GLYPH_MAX_ROWS      24      // Font24
+
+// A character of a font as PutChar draws it: each row as GetBitmapRow
+// returns it (leftmost pixel in bit 31), with the bits past the glyph's
+// width cleared.
+typedef struct
+    {
+    const sFONT *           font ;      // NULL while the entry is unused
+    char                    ch ;
+    uint32_t                rows[GLYPH_MAX_ROWS] ;
+    } GLYPH ;
+
+#define FERN_POINTS         100000
+#define FERN_Q              11      // fraction bits in a FERN_POINT coordinate
+
+typedef struct
+    {
+    int16_t                 x, y ;
+    } FERN_POINT ;
+
+#define IFS_MAX_MAPS        8
+
+// One affine map of an iterated function system, chosen with probability
+// p: x' = a*x + b*y + e, y' = c*x + d*y + f.
+typedef struct
+    {
+    float                   a, b, c, d, e, f ;
+    float                   p ;
+    } AFFINE ;
+
+typedef struct
+    {
+    const AFFINE *          maps ;
+    int                     count ;
+    uint32_t                threshold[IFS_MAX_MAPS] ;   // alias table, built by IfsInitialize
+    uint8_t                 alias[IFS_MAX_MAPS] ;
+    } IFS ;
+
+// SDRAM layout: the 32-bit screen followed by the fractals' cached data.
+#define SDRAM_SCREEN        0xD0000000
+#define SDRAM_MANDELBROT    (SDRAM_SCREEN + XPIXELS*YPIXELS*sizeof(CLR_RGB32))
+#define SDRAM_JULIA         (SDRAM_MANDELBROT + sizeof(ITERS))
+#define SDRAM_FERN          (SDRAM_JULIA + sizeof(ITERS))
+#define SDRAM_FRAMES        (SDRAM_FERN + FERN_POINTS*sizeof(FERN_POINT))
+#define SDRAM_SCRATCH       (SDRAM_FRAMES + FRAME_CACHE_SIZE)
+
+typedef struct
+    {
+    uint32_t                mirrored ;  // pixels copied from the row mirrored across the real axis
+    uint32_t                bulbs ;     // pixels inside the main cardioid or the period-2 bulb
+    uint32_t                periodic ;  // pixels whose orbit was caught repeating itself
+    uint32_t                filled ;    // pixels filled inside a uniform rectangle border
+    } FAST_PATHS ;
+
+// The counts that pixel functions bump are bumped from every thread of
+// RenderTiled, so there they are added to atomically.
+#ifdef PARALLEL
+#define COUNT_FAST_PATH(count)  __atomic_fetch_add(&fast_paths.count, 1, __ATOMIC_RELAXED)
+#else
+#define COUNT_FAST_PATH(count)  (fast_paths.count++)
+#endif
+
+// Where each Julia frame is in SDRAM_FRAMES, compressed by RleEncode. The
+// frames are packed in the order they are first drawn.
+typedef struct
+    {
+    uint32_t                offset[JULIA_FRAMES] ;
+    uint32_t                size[JULIA_FRAMES] ;    // 0 if not cached
+    uint32_t                used ;                  // bytes of FRAME_CACHE_SIZE taken
+    int                     frames ;                // cached so far
+    BOOL                    full ;                  // a frame did not fit: no more are cached
+    } CACHED_FRAMES ;
+
 extern sFONT                Font8, Font12, Font16, Font20, Font24 ;
 
+void                        DMA2D_IRQHandler(void) ;
+
 static BOOL                 Aborted(void) ;
 static void                 BarnsleyFernFractal(void) ;
+#ifdef BENCHMARK
+static void                 BenchmarkGlyphs(void) ;
+static void                 BenchmarkIfs(void) ;
+static void                 BenchmarkKernels(void) ;
+#endif
+#if defined(BENCHMARK) && defined(PARALLEL)
+static void                 BenchmarkThreads(void) ;
+#endif
+#ifdef BENCHMARK
+static void                 BenchmarkVector(void) ;
+#endif
+static void                 BlitRow(CLR_INDEX *dst, uint32_t bits, int width, CLR_INDEX color) ;
+static const GLYPH *        CachedGlyph(char ch, sFONT *font) ;
 static void                 ChromArtInitialize(void) ;
-static void                 ChromArtWaitForDMA(void) ;
-static void                 ChromArtXferFrameBuffer(CLR_RGB32 *screen_pixels, FRAME frame_pixels) ;
+static void                 ChromArtWaitForDMA(GFX_FENCE fence) ;
+static GFX_FENCE            ChromArtXferFrameBuffer(CLR_RGB32 *screen_pixels, FRAME frame_pixels, const DIRTY *dirty) ;
+#ifdef DEEP_ZOOM
+static void                 DeepZoomView(DEEP_VIEW *view, int steps) ;
+#endif
+static void                 DirtyAll(DIRTY *dirty) ;
+static void                 DirtyClear(DIRTY *dirty) ;
+static void                 DirtyMark(DIRTY *dirty, int x, int y) ;
+static void                 DirtyMerge(DIRTY *dirty, const DIRTY *more) ;
+static const ESCAPE_KERNEL *EscapeKernel(void) ;
+static BOOL                 EscapeKernelSupported(const ESCAPE_KERNEL *kernel) ;
+#if defined(__x86_64__) || defined(__i386__)
+static void                 EscapeRowAVX2(const float zx[], const float zy[], const float cx[], const float cy[], unsigned limit, uint8_t iters[], int count) ;
+static void                 EscapeRowSSE2(const float zx[], const float zy[], const float cx[], const float cy[], unsigned limit, uint8_t iters[], int count) ;
+#endif
+static void                 EscapeRowScalar(const float zx[], const float zy[], const float cx[], const float cy[], unsigned limit, uint8_t iters[], int count) ;
+static unsigned             EscapeTimeDouble(double zx, double zy, double cx, double cy, unsigned limit) ;
+static unsigned             EscapeTimeFloat(float zx, float zy, float cx, float cy, unsigned limit) ;
+static unsigned             EscapeTimeQ28(int32_t zx, int32_t zy, int32_t cx, int32_t cy, unsigned limit) ;
+static void                 FractalBackground(char *title) ;
 static void                 FractalTitle(char *title) ;
+#ifdef FRAME_CACHE
+static BOOL                 FrameCacheLoad(CACHED_FRAMES *cache, int frame, FRAME frame_pixels) ;
+static void                 FrameCacheStore(CACHED_FRAMES *cache, int frame, FRAME frame_pixels) ;
+#endif
 static uint32_t             GetTimeout(uint32_t msec) ;
-static CLR_RGB32            HSV2RGB(float hue, float sat, float val) ;
+#ifdef GOVERNOR
+static int                  GovernorQuality(const FRAME_GOVERNOR *governor, VIEW *view) ;
+static void                 GovernorUpdate(FRAME_GOVERNOR *governor, uint32_t start, uint32_t timeout) ;
+#endif
+static GFX_FENCE            GfxBlend(const uint8_t *mask, int maskSkip, CLR_RGB32 color, CLR_RGB32 *dst, int dstSkip, int width, int height) ;
+static void                 GfxComplete(void) ;
+static GFX_FENCE            GfxConvert(const CLR_INDEX *src, int srcSkip, CLR_RGB32 *dst, int dstSkip, int width, int height) ;
+static GFX_FENCE            GfxCopy(const CLR_INDEX *src, int srcSkip, CLR_INDEX *dst, int dstSkip, int width, int height) ;
+static BOOL                 GfxDone(GFX_FENCE fence) ;
+static GFX_FENCE            GfxFill(uint32_t *dst, int dstSkip, int width, int height, uint32_t value) ;
+static GFX_FENCE            GfxFillFrame(FRAME frame_pixels, CLR_INDEX color) ;
+static GFX_FENCE            GfxLoadClut(const CLR_RGB32 *palette, int entries) ;
+static void                 GfxService(void) ;
+static void                 GfxStart(void) ;
+static GFX_FENCE            GfxSubmit(const GFX_COMMAND *cmd) ;
+static BOOL                 IfsGenerate(const IFS *ifs, FERN_POINT points[], int count) ;
+static void                 IfsInitialize(IFS *ifs) ;
+static BOOL                 InsideMainBulbs(float px, float py) ;
+static unsigned             JuliaPixel(const VIEW *view, int x, int y) ;
 static void                 JuliaSetFractal(void) ;
+static void                 JuliaView(VIEW *view, int degrees) ;
 static void                 LEDs(int grn_on, int red_on) ;
+#ifdef LTDC_L8
+static void                 LtdcInitialize(void) ;
+static void                 LtdcLoadClut(CLR_INDEX offset) ;
+static void                 LtdcShowFrame(FRAME frame_pixels) ;
+static void                 LtdcWriteClut(int color, CLR_RGB32 rgb) ;
+#endif
+#ifdef LTDC_EMULATED
+static void                 LtdcScanout(CLR_RGB32 *dst) ;
+#endif
+static unsigned             MandelbrotPixel(const VIEW *view, int x, int y) ;
 static void                 MandelbrotSetFractal(void) ;
-static CLR_RGB32            PackRGB(int red, int grn, int blu) ;
-static void                 PutChar(int x, int y, char c, sFONT *font) ;
-static void                 PutString(int x, int y, char *str, sFONT *font) ;
+static void                 MandelbrotView(VIEW *view) ;
+#ifdef DEEP_ZOOM
+static void                 MandelbrotZoomFractal(void) ;
+#endif
+static uint8_t              MapPixel(const VIEW *view, ITERS *map, int x, int y) ;
+static int                  MirrorRow(const VIEW *view, int y) ;
+static void                 MirrorRows(const VIEW *view, ITERS *map, int first) ;
+#ifdef DEEP_ZOOM
+static unsigned             PerturbedPixel(const ORBIT *orbit, float dcx, float dcy, unsigned limit) ;
+#endif
+static void                 PresentChanges(const DIRTY *drawn) ;
+static void                 PresentFrame(void) ;
+static void                 PutChar(CLR_INDEX (*pixels)[WIDTH], int x, int y, char c, sFONT *font) ;
+#ifdef BENCHMARK
+static void                 PutCharBitwise(CLR_INDEX (*pixels)[WIDTH], int x, int y, char c, sFONT *font) ;
+#endif
+static void                 PutString(CLR_INDEX (*pixels)[WIDTH], int x, int y, char *str, sFONT *font) ;
+#ifdef DEEP_ZOOM
+static void                 ReferenceOrbit(double cx, double cy, unsigned limit, ORBIT *orbit) ;
+#endif
+#if defined(PROGRESSIVE) || defined(GOVERNOR)
+static void                 RemapBlocks(const VIEW *view, ITERS *map, const CLR_INDEX colors[], FRAME frame_pixels, int step, int rows) ;
+#endif
+static void                 RemapIterations(ITERS *map, const CLR_INDEX colors[], FRAME frame_pixels) ;
+#ifdef DEEP_ZOOM
+static BOOL                 RenderPerturbed(const DEEP_VIEW *view, ITERS *map, int *references) ;
+#endif
+#ifdef PROGRESSIVE
+static int                  RenderProgressive(const VIEW *view, ITERS *map, const CLR_INDEX colors[], const uint32_t *timeout) ;
+#endif
+static BOOL                 RenderRaster(const VIEW *view, ITERS *map) ;
+#ifdef GOVERNOR
+static BOOL                 RenderSampled(const VIEW *view, ITERS *map, const CLR_INDEX colors[], int step) ;
+#endif
+static BOOL                 RenderSubdivided(const VIEW *view, ITERS *map) ;
+#ifdef PARALLEL
+static void                 RenderTile(void *arg, int tile) ;
+static BOOL                 RenderTiled(const VIEW *view, ITERS *map) ;
+#endif
+static BOOL                 RenderVector(const VIEW *view, ITERS *map) ;
+#ifdef SELF_TEST
+static BOOL                 RenderersAgree(void) ;
+#endif
+#ifdef FRAME_CACHE
+static void                 RleDecode(const uint8_t *src, uint8_t *dst, int count) ;
+static int                  RleEncode(const uint8_t *src, int count, uint8_t *dst, int room) ;
+#endif
+static int                  RowsToCompute(const VIEW *view) ;
+#if defined(PROGRESSIVE) || defined(GOVERNOR)
+static BOOL                 SampleGrid(const VIEW *view, ITERS *map, int step, int rows) ;
+#endif
 static int                  SanityChecksOK(void) ;
+#if defined(SELF_TEST) && defined(LTDC_EMULATED)
+static BOOL                 ScanoutAgrees(void) ;
+#endif
+static BOOL                 SubdivideRows(const VIEW *view, ITERS *map, int rows) ;
 static void                 TextColor(CLR_INDEX color) ;
+static void                 ViewOrbits(const VIEW *view, int y, float zx[], float zy[], float cx[], float cy[]) ;
 static void                 WaitForTimeout(uint32_t timeout) ;
 
 static CLR_INDEX            textColor ;
+
+// In flash: the hue palette twice over, so that any rotation of it is 255
+// consecutive entries, which the DMA2D can load into its CLUT by itself.
+static const CLR_RGB32      hue_cycle[2*HUE_COLORS + 2] =
+    {
+    HUE_RGB64(0), HUE_RGB64(64), HUE_RGB64(128), HUE_RGB64(192),
+    HUE_RGB64(256), HUE_RGB64(320), HUE_RGB64(384), HUE_RGB64(448)
+    } ;
+static GLYPH                glyph_cache[GLYPH_CACHE_SIZE] ;
 static uint32_t * const     AHB1ENR         = (uint32_t *)  0x40023800 ;
+static uint32_t * const     NVIC_ISER2 __attribute__((unused)) = (uint32_t *) 0xE000E108 ;
 static CHROM_ART * const    DMA2D           = (CHROM_ART *) 0x4002B000 ;
 static CLR_RGB32 * const    FG_CLUT         = (CLR_RGB32 *) 0x4002B400 ; 
+#if defined(LTDC_EMULATED)
+static LCD_TFT              ltdc_emulated ;
+static CLR_RGB32            ltdc_clut[256] ;    // what the emulated CLUTWR has loaded
+static LCD_TFT * const      LTDC            = &ltdc_emulated ;
+#elif defined(LTDC_L8)
+static LCD_TFT * const      LTDC            = (LCD_TFT *)   0x40016800 ;
+#endif
 static const CLR_INDEX      INDEX_RED       = COLOR_INDEX(HUE_RED) ;
 static const CLR_INDEX      INDEX_YLW       = COLOR_INDEX(HUE_YLW) ;
 static const CLR_INDEX      INDEX_GRN       = COLOR_INDEX(HUE_GRN) ;
-static CLR_RGB32 * const    screen_pixels   = (CLR_RGB32 *) 0xD0000000 ;
-static FRAME                frame_pixels ;
+static CLR_RGB32 * const    screen_pixels   = (CLR_RGB32 *) SDRAM_SCREEN ;
+static ITERS * const        mandelbrot_map  = (ITERS *) SDRAM_MANDELBROT ;
+static ITERS * const        julia_map       = (ITERS *) SDRAM_JULIA ;
+static FERN_POINT * const   fern_points     = (FERN_POINT *) SDRAM_FERN ;
+#ifdef FRAME_CACHE
+static uint8_t * const      frame_store     = (uint8_t *) SDRAM_FRAMES ;
+static CACHED_FRAMES        julia_frames ;
+#endif
+static FRAME                frames[2] ;     // drawn into and converted by DMA2D in turn
+static int                  back_frame ;    // index of the one being drawn into
+static CLR_INDEX            (*frame_pixels)[WIDTH] = frames[0] ;
+static GFX_FENCE            frame_fence[2] __attribute__((unused)) ; // conversion of each frame
+static DIRTY                screen_dirty ;      // what the screen shows beyond the fill color
+static CLR_INDEX            title_mask[TITLE_ROWS][WIDTH] ;
+static GFX_COMMAND          gfx_queue[GFX_QUEUE_SIZE] ;
+static volatile GFX_FENCE   gfx_queued ;        // commands submitted so far
+static volatile GFX_FENCE   gfx_completed ;     // commands finished so far
 static BOOL                 aborted ;
 
+static const AFFINE         fern_maps[] =
+    {
+    //  a        b        c        d        e       f       p
+    {  0.00f,   0.00f,   0.00f,   0.16f,   0.0f,   0.00f,  0.02f},
+    {  0.20f,  -0.26f,   0.23f,   0.22f,   0.0f,   1.60f,  0.07f},
+    { -0.15f,   0.28f,   0.26f,   0.24f,   0.0f,   0.44f,  0.07f},
+    {  0.85f,   0.04f,  -0.04f,   0.85f,   0.0f,   1.60f,  0.84f}
+    } ;
+static IFS                  fern            = {fern_maps, ITEMS(fern_maps), {0}, {0}} ;
+#ifdef GOVERNOR
+static const QUALITY        qualities[] =   // best first, each cheaper than the last
+    {
+    {50, 1}, {40, 1}, {32, 1}, {50, 2}, {40, 2}, {32, 2}, {32, 4}, {24, 4}
+    } ;
+#endif
+static FAST_PATHS           fast_paths ;
+static const ESCAPE_KERNEL  escape_kernels[] =  // narrowest first
+    {
+    {"scalar", 1, EscapeRowScalar},
+#if defined(__x86_64__) || defined(__i386__)
+    {"SSE2",   4, EscapeRowSSE2},
+    {"AVX2",   8, EscapeRowAVX2},
+#endif
+    } ;
+#ifdef PARALLEL
+static int                  tile_threads ;  // RenderTiled's threads; 0 for HostCpuCount()
+static _Thread_local BOOL   tile_caller ;   // this thread called RenderTiled
+#endif
+#ifdef DEEP_ZOOM
+static ORBIT                reference ;
+#endif
+
 int main()
     {
     static void (* const fractals[])(void) =
         {
         BarnsleyFernFractal,
+#ifdef DEEP_ZOOM
+        MandelbrotZoomFractal,
+#else
         MandelbrotSetFractal,
+#endif
         JuliaSetFractal
         } ;
 
     InitializeHardware(HEADER, "Lab 5B: Pixels, Fonts & Fractals") ;
     if (!SanityChecksOK()) return 0 ;
     ChromArtInitialize() ;
+#ifdef BENCHMARK
+    BenchmarkKernels() ;
+    BenchmarkVector() ;
+    BenchmarkGlyphs() ;
+    BenchmarkIfs() ;
+#endif
+#if defined(BENCHMARK) && defined(PARALLEL)
+    BenchmarkThreads() ;
+#endif
+#ifdef SELF_TEST
+    if (!RenderersAgree()) return 0 ;
+#endif
+#if defined(SELF_TEST) && defined(LTDC_EMULATED)
+    if (!ScanoutAgrees()) return 0 ;
+#endif
     for (int fractal = 0;; fractal = (fractal + 1) % ITEMS(fractals))
         {
         (*fractals[fractal])() ;
@@ -150,305 +714,2196 @@ int main()
 
 static void BarnsleyFernFractal(void)
     {
-    const int   LIMIT   = 100000 ;
     const float X_ZOOM  = 88 ;
     const float Y_ZOOM  = 112 ;
+    static BOOL cached = FALSE ;    // TRUE once fern_points holds the orbit
+    static DIRTY drawn ;
     float zoom, inc ;
 
     aborted = FALSE ;
+    FractalBackground("Barnsley Fern") ;
+
+    // The attractor does not depend on the zoom, so its orbit is generated
+    // only once; each frame just projects the cached points.
+    if (!cached)
+        {
+        IfsInitialize(&fern) ;
+        if (!IfsGenerate(&fern, fern_points, FERN_POINTS)) return ;
+        cached = TRUE ;
+        }
+
     zoom = 1.0 ;
     inc = 0.25 ;
     while (TRUE)
         {
         uint32_t timeout = GetTimeout(100) ;
-        float x, y ;
-
-        memset(frame_pixels, INDEX_RED, sizeof(frame_pixels)) ;
-        FractalTitle("Barnsley Fern") ;
-
-        x = y = 0.0 ;
-        for (int i = 0; i < LIMIT; i++)
+        int32_t xscale = (int32_t) (((XSIZE*zoom)/X_ZOOM) * (1 << (16 - FERN_Q))) ;
+        int32_t yscale = (int32_t) (((YSIZE*zoom)/Y_ZOOM) * (1 << (16 - FERN_Q))) ;
+
+        // The CPU clears the frame: a DMA2D fill would queue behind the
+        // conversion of the last frame, and waiting for it would wait for
+        // that conversion too instead of drawing while it runs.
+        memset(frame_pixels[0], INDEX_RED, YSIZE*WIDTH) ;
+        DirtyClear(&drawn) ;
+
+        // Dividing (rather than shifting) truncates toward zero, as the
+        // float-to-int conversion of the original projection did; the scales
+        // themselves are rounded to Q16, so a point on a pixel boundary can
+        // land one pixel from where the float projection put it.
+        for (int i = 0; i < FERN_POINTS; i++)
             {
-            int r = GetRandomNumber() % 100 ;
-            float newX, newY ;
             unsigned pxlX, pxlY ;
 
-            if (r <= 1)
-                {
-                newX = 0.00 ;
-                newY = 0.16 * y ;
-                }
-            else if (r <= 8)
-                {
-                newX = 0.20 * x - 0.26 * y ;
-                newY = 0.23 * x + 0.22 * y + 1.6 ;
-                }
-            else if (r <= 15)
-                {
-                newX = -0.15 * x + 0.28 * y ;
-                newY =  0.26 * x + 0.24 * y + 0.44 ;
-                }
-            else
-                {
-                newX =  0.85 * x + 0.04 * y ;
-                newY = -0.04 * x + 0.85 * y + 1.6 ;
-                }
-
-            x = newX ;
-            y = newY ;
-
-            pxlY = YSIZE - (int) (y * ((YSIZE*zoom)/Y_ZOOM)) ;
-            if (pxlY > YSIZE) continue ;
-            pxlX = XSIZE/2 + (int) (x * ((XSIZE*zoom)/X_ZOOM)) ;
-            if (pxlX > XSIZE) continue ;
+            pxlY = YSIZE - (fern_points[i].y * yscale) / 65536 ;
+            if (pxlY >= YSIZE) continue ;
+            pxlX = XSIZE/2 + (fern_points[i].x * xscale) / 65536 ;
+            if (pxlX >= XSIZE) continue ;
             WritePixel(pxlX, pxlY, INDEX_GRN, frame_pixels) ;
-            if (Aborted()) return ;
+            DirtyMark(&drawn, pxlX, pxlY) ;
             }
+        if (Aborted()) return ;
 
-        ChromArtXferFrameBuffer(screen_pixels, frame_pixels) ;
+        // Only the fern's rows, and those of the last fern, are converted.
+        PresentChanges(&drawn) ;
         zoom += inc ;
         if (zoom >= 26.0) inc = -0.25 ;
         if (zoom <=  1.0) inc = +0.25 ;
         WaitForTimeout(timeout) ;
-        ChromArtWaitForDMA() ;
         }
     }
 
-static void MandelbrotSetFractal(void)
+// Builds the Walker alias table of an IFS so that a map can be chosen
+// with one random number and one comparison: column i is kept with
+// probability threshold[i]/2^16 and otherwise replaced by alias[i].
+static void IfsInitialize(IFS *ifs)
     {
-    const int   limit   = 18 ;
-    const float X_ZOOM  = 1.30 ;
-    const float Y_ZOOM  = 0.75 ;
-    const float X_OFF   = -0.5 ;
-    const float Y_OFF   = 0.0 ;
-    CLR_INDEX clroff ;
+    float scaled[IFS_MAX_MAPS] ;
+    int small[IFS_MAX_MAPS], large[IFS_MAX_MAPS] ;
+    int smalls, larges ;
 
-    memset(frame_pixels, INDEX_RED, sizeof(frame_pixels)) ;
-    FractalTitle("Mandelbrot Set") ;
+    smalls = larges = 0 ;
+    for (int i = 0; i < ifs->count; i++)
+        {
+        scaled[i] = ifs->maps[i].p * ifs->count ;
+        if (scaled[i] < 1.0f) small[smalls++] = i ;
+        else                  large[larges++] = i ;
+        }
 
-    aborted = FALSE ;
-    clroff = 0 ;
-    while (TRUE)
+    while (smalls > 0 && larges > 0)
         {
-        uint32_t timeout = GetTimeout(200) ;
-        for (int y = 0; y < YSIZE; y++)
+        int s = small[--smalls] ;
+        int l = large[larges - 1] ;
+
+        ifs->threshold[s] = (uint32_t) (scaled[s] * 65536.0f) ;
+        ifs->alias[s] = l ;
+        scaled[l] -= 1.0f - scaled[s] ;
+        if (scaled[l] < 1.0f)
             {
-            for (int x = 0; x < XSIZE; x++)
-                {
-                float py = Y_OFF + (y - YSIZE/2) * (2.0 / (Y_ZOOM * YSIZE)) ;
-                float px = X_OFF + (x - XSIZE/2) * (3.0 / (X_ZOOM * XSIZE)) ;
-                CLR_INDEX clridx ;
-                unsigned iter ;
-                float zx, zy ;
-
-                zx = px ; zy = py ;
-                for (iter = 0; iter < limit; iter++)
-                    {
-                    float zxSquared = zx*zx ;
-                    float zySquared = zy*zy ;
+            larges-- ;
+            small[smalls++] = l ;
+            }
+        }
 
-                    if (zxSquared + zySquared > 4.0) break ;
+    // Whatever is left has (up to rounding) probability 1 of being kept.
+    while (larges > 0) ifs->threshold[large[--larges]] = 65536 ;
+    while (smalls > 0) ifs->threshold[small[--smalls]] = 65536 ;
+    }
 
-                    zy = py + 2.0*zx*zy ;
-                    zx = px + zxSquared - zySquared ;
-                    if (Aborted()) return ;
-                    }
+// Runs an iterated function system from the origin and stores its orbit
+// as Q4.11 points. Returns FALSE if the push button interrupted it.
+static BOOL IfsGenerate(const IFS *ifs, FERN_POINT points[], int count)
+    {
+    float x, y ;
+
+    x = y = 0.0f ;
+    for (int i = 0; i < count; i++)
+        {
+        uint32_t r = GetRandomNumber() ;
+        unsigned col = ((r >> 16) * ifs->count) >> 16 ;
+        const AFFINE *map = &ifs->maps[(r & 0xFFFF) < ifs->threshold[col] ? col : ifs->alias[col]] ;
+        float newX = map->a * x + map->b * y + map->e ;
+        float newY = map->c * x + map->d * y + map->f ;
+
+        x = newX ;
+        y = newY ;
+
+        points[i].x = (int16_t) (x * (1 << FERN_Q)) ;
+        points[i].y = (int16_t) (y * (1 << FERN_Q)) ;
+        if ((i % 1024) == 0 && Aborted()) return FALSE ;
+        }
+
+    return TRUE ;
+    }
+
+#ifdef BENCHMARK
+// Draws the printable characters into both frames in each font, with
+// PutCharBitwise into one and PutChar into the other, and reports the
+// glyphs per second of each and whether the frames came out the same.
+static void BenchmarkGlyphs(void)
+    {
+    static sFONT * const fonts[] = {&Font8, &Font12, &Font16, &Font20, &Font24} ;
+    const int REPEATS = 20 ;
+    char text[100] ;
+    int row ;
+
+    ClearDisplay() ;
+    row = Y_MIN ;
+    DisplayStringAt(0, row, "Font  bitwise  cached =") ;
+    row += 2 * Font16.Height ;
+
+    TextColor(INDEX_YLW) ;
+    for (int f = 0; f < (int) ITEMS(fonts); f++)
+        {
+        sFONT * const font = fonts[f] ;
+        const int cols = XSIZE / font->Width ;
+        const int glyphs = REPEATS * ('~' - ' ' + 1) ;
+        uint32_t cycles[2] ;
+
+        for (int method = 0; method < 2; method++)
+            {
+            uint32_t start ;
+
+            memset(frames[method], 0, sizeof(FRAME)) ;
+            start = GetClockCycleCount() ;
+            for (int i = 0; i < glyphs; i++)
+                {
+                int n = i % ('~' - ' ' + 1) ;
+                int x = (n % cols) * font->Width ;
+                int y = (n / cols) * font->Height ;
 
-                clridx = (clroff + (255*iter)/limit) % 255 ;
-                if (iter == limit) clridx = 255 ;
-                WritePixel(x, y, clridx, frame_pixels) ;
+                if (method == 0) PutCharBitwise(frames[0], x, y, ' ' + n, font) ;
+                else             PutChar(frames[1], x, y, ' ' + n, font) ;
                 }
+            cycles[method] = GetClockCycleCount() - start ;
             }
 
-        ChromArtXferFrameBuffer(screen_pixels, frame_pixels) ;
-        clroff += 5 ;
-        WaitForTimeout(timeout) ;
-        ChromArtWaitForDMA() ;
+        sprintf(text, "%4d %8lu %7lu %s", font->Height,
+            (unsigned long) (glyphs * (CPU_CLOCK_SPEED_MHZ * 1e6f / cycles[0])),
+            (unsigned long) (glyphs * (CPU_CLOCK_SPEED_MHZ * 1e6f / cycles[1])),
+            memcmp(frames[0], frames[1], sizeof(FRAME)) == 0 ? "Y" : "N") ;
+        DisplayStringAt(0, row, text) ;
+        row += Font16.Height ;
         }
+
+    DisplayStringAt(0, row + Font16.Height, "glyphs/second; press button") ;
+    WaitForPushButton() ;
     }
 
-static void JuliaSetFractal(void)
+// Generates FERN_POINTS points with the original if/else chain on
+// GetRandomNumber() % 100 and with the alias-table IFS engine, and
+// reports the throughput of each.
+static void BenchmarkIfs(void)
     {
-    const int   limit   = 50;
-    const float X_ZOOM  = 1.20 ;
-    const float Y_ZOOM  = 0.65 ;
-    const float X_OFF   = 0.0 ;
-    const float Y_OFF   = 0.0 ;
-    int degrees ;
+    uint32_t cycles[2], start ;
+    char text[100] ;
+    float x, y ;
+    int row ;
 
-    memset(frame_pixels, INDEX_RED, sizeof(frame_pixels)) ;
-    FractalTitle("Julia Set") ;
+    start = GetClockCycleCount() ;
+    x = y = 0.0 ;
+    for (int i = 0; i < FERN_POINTS; i++)
+        {
+        int r = GetRandomNumber() % 100 ;
+        float newX, newY ;
 
-    aborted = FALSE ;
-    degrees = 0 ;
-    while (TRUE)
+        if (r <= 1)
+            {
+            newX = 0.00 ;
+            newY = 0.16 * y ;
+            }
+        else if (r <= 8)
+            {
+            newX = 0.20 * x - 0.26 * y ;
+            newY = 0.23 * x + 0.22 * y + 1.6 ;
+            }
+        else if (r <= 15)
+            {
+            newX = -0.15 * x + 0.28 * y ;
+            newY =  0.26 * x + 0.24 * y + 0.44 ;
+            }
+        else
+            {
+            newX =  0.85 * x + 0.04 * y ;
+            newY = -0.04 * x + 0.85 * y + 1.6 ;
+            }
+
+        x = newX ;
+        y = newY ;
+        fern_points[i].x = (int16_t) (x * (1 << FERN_Q)) ;
+        fern_points[i].y = (int16_t) (y * (1 << FERN_Q)) ;
+        }
+    cycles[0] = GetClockCycleCount() - start ;
+
+    IfsInitialize(&fern) ;
+    start = GetClockCycleCount() ;
+    IfsGenerate(&fern, fern_points, FERN_POINTS) ;
+    cycles[1] = GetClockCycleCount() - start ;
+
+    ClearDisplay() ;
+    row = Y_MIN ;
+    DisplayStringAt(0, row, "IFS points/second") ;
+    row += 2 * Font16.Height ;
+    sprintf(text, "if/else: %8lu", (unsigned long) (FERN_POINTS * (CPU_CLOCK_SPEED_MHZ * 1e6f / cycles[0]))) ;
+    DisplayStringAt(0, row, text) ;
+    row += Font16.Height ;
+    sprintf(text, "  alias: %8lu", (unsigned long) (FERN_POINTS * (CPU_CLOCK_SPEED_MHZ * 1e6f / cycles[1]))) ;
+    DisplayStringAt(0, row, text) ;
+    DisplayStringAt(0, row + 2 * Font16.Height, "press button") ;
+    WaitForPushButton() ;
+    }
+#endif
+
+#if defined(BENCHMARK) && defined(PARALLEL)
+// Times RenderTiled on the first Julia set with 1, 2, 4, ... threads up to
+// HostCpuCount(), and checks each map against RenderRaster's.
+static void BenchmarkThreads(void)
+    {
+    const int REPEATS = 10 ;
+    const int threads = HostCpuCount() ;
+    uint32_t cycles, single = 0 ;
+    char text[100] ;
+    VIEW view ;
+    int row ;
+
+    JuliaView(&view, 0) ;
+    RenderRaster(&view, mandelbrot_map) ;
+
+    ClearDisplay() ;
+    row = Y_MIN ;
+    DisplayStringAt(0, row, "Threads  usec  x1  diffs") ;
+    row += 2 * Font16.Height ;
+
+    for (tile_threads = 1;; tile_threads = (2*tile_threads < threads) ? 2*tile_threads : threads)
         {
-        float radians = (degrees * 2 * PI) / 360.0 ;
-        float pX = 0.7885 * cosf(radians) ;
-        float pY = 0.7885 * sinf(radians) ;
-        uint32_t timeout = GetTimeout(100) ;
+        unsigned diffs = 0 ;
+        uint32_t start = GetClockCycleCount() ;
+
+        for (int i = 0; i < REPEATS; i++) RenderTiled(&view, julia_map) ;
+        cycles = (GetClockCycleCount() - start) / REPEATS ;
+        if (tile_threads == 1) single = cycles ;
 
         for (int y = 0; y < YSIZE; y++)
             {
             for (int x = 0; x < XSIZE; x++)
                 {
-                float zy = Y_OFF + (y - YSIZE/2) * (2.0 / (Y_ZOOM * YSIZE)) ;
-                float zx = X_OFF + (x - XSIZE/2) * (3.0 / (X_ZOOM * XSIZE)) ;
-                int iter ;
+                if ((*julia_map)[y][x] != (*mandelbrot_map)[y][x]) diffs++ ;
+                }
+            }
 
-                for (iter = 0; iter < limit; iter++)
-                    {
-                    float zxSquared = zx*zx ;
-                    float zySquared = zy*zy ;
+        sprintf(text, "%7d %5u %2u.%u %5u", tile_threads,
+            (unsigned) (cycles / CPU_CLOCK_SPEED_MHZ),
+            (unsigned) (single / cycles), (unsigned) ((10 * single / cycles) % 10), diffs) ;
+        DisplayStringAt(0, row, text) ;
+        row += Font16.Height ;
+        if (tile_threads == threads) break ;
+        }
+    tile_threads = 0 ;
 
-                    if (zxSquared + zySquared > 4) break ;
+    DisplayStringAt(0, row + Font16.Height, "press button") ;
+    WaitForPushButton() ;
+    }
+#endif
 
-                    zx  = pX + 2.0*zx*zy ;
-                    zy  = pY + zySquared - zxSquared ;
-                    if (Aborted()) return ;
-                    }
+static void __attribute__((unused)) MandelbrotSetFractal(void)
+    {
+    static BOOL mapped = FALSE ;    // TRUE once mandelbrot_map holds this view
+    CLR_INDEX colors[256] ;
+#ifdef BENCHMARK
+    static FAST_PATHS counts ;      // this view's: Julia frames add to fast_paths too
+    char text[100] ;
+#endif
+    CLR_INDEX clroff ;
+    VIEW view ;
 
-                WritePixel(x, y, (255 * iter) / limit , frame_pixels) ;
-                }
+    FractalBackground("Mandelbrot Set") ;
+
+    aborted = FALSE ;
+
+    // The view never changes, so the escape counts are computed only once;
+    // each frame below is just a remap of those counts to color indices.
+    MandelbrotView(&view) ;
+    if (!mapped)
+        {
+        memset(&fast_paths, 0, sizeof(fast_paths)) ;
+#ifdef PROGRESSIVE
+        // The coarse passes are shown in the colors of the first frame.
+        for (unsigned iter = 0; iter < view.limit; iter++)
+            {
+            colors[iter] = (255*iter)/view.limit ;
             }
+        colors[view.limit] = 255 ;
+        if (RenderProgressive(&view, mandelbrot_map, colors, NULL) == 0) return ;
+#else
+        if (!MANDELBROT_RENDERER(&view, mandelbrot_map)) return ;
+#endif
+#ifdef BENCHMARK
+        counts = fast_paths ;
+#endif
+        mapped = TRUE ;
+        }
 
-        ChromArtXferFrameBuffer(screen_pixels, frame_pixels) ;
-        degrees = (degrees + 3) % 360 ;
-        WaitForTimeout(timeout) ;
-        ChromArtWaitForDMA() ;
+#ifdef BENCHMARK
+    sprintf(text, "mirror %lu bulb %lu cycle %lu fill %lu",
+        (unsigned long) counts.mirrored,
+        (unsigned long) counts.bulbs,
+        (unsigned long) counts.periodic,
+        (unsigned long) counts.filled) ;
+    DisplayFooter(text) ;
+#endif
+
+    // The frame is remapped once; the colors then cycle in the CLUT: the
+    // layer's with LTDC_L8, otherwise the DMA2D's, reloaded from hue_cycle
+    // before each conversion of the (unchanging) frame.
+    clroff = 0 ;
+    for (unsigned iter = 0; iter < view.limit; iter++)
+        {
+        colors[iter] = (255*iter)/view.limit ;
+        }
+    colors[view.limit] = 255 ;
+    RemapIterations(mandelbrot_map, colors, frame_pixels) ;
+#ifdef LTDC_L8
+    PresentFrame() ;
+#else
+    GfxCopy(frame_pixels[0], 0, frames[1 - back_frame][0], 0, WIDTH, YSIZE) ;
+#endif
+    while (TRUE)
+        {
+        uint32_t timeout = GetTimeout(200) ;
 
+#ifdef LTDC_L8
+        LtdcLoadClut(clroff) ;
+#else
+        GfxLoadClut(&hue_cycle[clroff % HUE_COLORS], HUE_COLORS) ;
+        PresentFrame() ;
+#endif
+        clroff += 5 ;
+        WaitForTimeout(timeout) ;
+        if (aborted) return ;
         }
     }
 
-static BOOL Aborted(void)
+static void JuliaSetFractal(void)
     {
-    if (PushButtonPressed()) aborted = TRUE ;
-    return aborted ;
-    }
+    CLR_INDEX colors[256] ;
+    int degrees, step = 1 ;
+#ifdef GOVERNOR
+    static FRAME_GOVERNOR governor ;  // keeps its level from one visit to the next
 
-static CLR_RGB32 HSV2RGB(float hue, float sat, float val)
-    {
-    static float p, q, t ;
-    float * const pRed[] = {&val, &q, &p, &p, &t, &val} ;
-    float * const pGrn[] = {&t, &val, &val, &q, &p, &p} ;
-    float * const pBlu[] = {&p, &p, &t, &val, &val, &q} ;
-    int i, r, g, b ;
-    float f, h ;
+    governor.frames = 0 ;
+    governor.since = GetClockCycleCount() ;
+#endif
 
-    h = hue / 60.0 ;    // 0.0 <= h < 6.0
-    i = (unsigned) h ;  //   0 <= i < 6
-    f = h - (float) i ; //   0 <= f < 6.0
+    FractalBackground("Julia Set") ;
 
-    p = val * (1.0 - sat) ;
-    q = val * (1.0 - f*sat) ;
-    t = val * (1.0 - (1.0 - f)*sat) ;
+    aborted = FALSE ;
+    degrees = 0 ;
+    while (TRUE)
+        {
+#ifdef GOVERNOR
+        uint32_t start = GetClockCycleCount() ;
+#endif
+        uint32_t timeout = GetTimeout(100) ;
+        VIEW view ;
 
-    r = (int) (*pRed[i] * 255.0) ;
-    g = (int) (*pGrn[i] * 255.0) ;
-    b = (int) (*pBlu[i] * 255.0) ;
+#ifdef FRAME_CACHE
+        if (FrameCacheLoad(&julia_frames, degrees / JULIA_DEGREES, frame_pixels))
+            {
+            PresentFrame() ;
+            degrees = (degrees + JULIA_DEGREES) % 360 ;
+            WaitForTimeout(timeout) ;
+            if (aborted) return ;
+            continue ;
+            }
+#endif
+        JuliaView(&view, degrees) ;
+#ifdef GOVERNOR
+        step = GovernorQuality(&governor, &view) ;
+#endif
+        for (unsigned iter = 0; iter <= view.limit; iter++)
+            {
+            colors[iter] = (255 * iter) / view.limit ;
+            }
 
-    return PackRGB(r, g, b) ;
+#if defined(GOVERNOR)
+        // The governor's step takes the place of progressive refinement.
+        if (step > 1)
+            {
+            if (!RenderSampled(&view, julia_map, colors, step)) return ;
+            }
+        else if (!JULIA_RENDERER(&view, julia_map)) return ;
+#elif defined(PROGRESSIVE)
+        // A frame that runs out of time has already been shown at the
+        // coarser step it reached; only a complete map is shown here.
+        step = RenderProgressive(&view, julia_map, colors, &timeout) ;
+        if (step == 0) return ;
+#else
+        if (!JULIA_RENDERER(&view, julia_map)) return ;
+#endif
+        if (step == 1)
+            {
+            RemapIterations(julia_map, colors, frame_pixels) ;
+#if defined(FRAME_CACHE) && defined(GOVERNOR)
+            // Only frames of the best quality are kept for good.
+            if (governor.level == 0) FrameCacheStore(&julia_frames, degrees / JULIA_DEGREES, frame_pixels) ;
+#elif defined(FRAME_CACHE)
+            FrameCacheStore(&julia_frames, degrees / JULIA_DEGREES, frame_pixels) ;
+#endif
+            PresentFrame() ;
+            }
+#ifdef GOVERNOR
+        GovernorUpdate(&governor, start, timeout) ;
+#endif
+        degrees = (degrees + JULIA_DEGREES) % 360 ;
+        WaitForTimeout(timeout) ;
+        if (aborted) return ;
+        }
     }
 
-static void ChromArtInitialize(void)
+#ifdef FRAME_CACHE
+// Compresses a frame into the cache unless it is there already. Once a
+// frame does not fit in what is left of FRAME_CACHE_SIZE, no more are
+// stored and the frames not cached go on being rendered.
+static void FrameCacheStore(CACHED_FRAMES *cache, int frame, FRAME frame_pixels)
     {
-    uint32_t timeout ;
-    int color ;
-
-    *AHB1ENR |= (1 << 23) ; // Turn on DMA2D clock
-    timeout = GetTimeout(1) ;
-    while ((int) (timeout - GetClockCycleCount()) > 0) ;
+#ifdef BENCHMARK
+    char text[100] ;
+#endif
+    int size ;
 
-    // Load color look-up table (CLUT)
-    for (color = 0; color < 255; color++)
+    if (cache->size[frame] != 0 || cache->full) return ;
+    size = RleEncode(frame_pixels[0], WIDTH*YSIZE, frame_store + cache->used, FRAME_CACHE_SIZE - cache->used) ;
+    if (size < 0)
         {
-        float hue = (360.0 * color) / 256 ;
-        FG_CLUT[color] = HSV2RGB(hue, 1.0, 1.0) ;
+        cache->full = TRUE ;
+        return ;
         }
-    FG_CLUT[color] = COLOR_BLACK ;
+    cache->offset[frame] = cache->used ;
+    cache->size[frame] = size ;
+    cache->used += size ;
+    cache->frames++ ;
+
+#ifdef BENCHMARK
+    sprintf(text, "%d frames cached in %lu KB, %lu%%", cache->frames,
+        (unsigned long) (cache->used / 1024),
+        (unsigned long) (100ull * cache->used / ((uint32_t) cache->frames * WIDTH*YSIZE))) ;
+    DisplayFooter(text) ;
+#endif
+    }
+
+// Decompresses a cached frame; returns FALSE if the frame is not cached.
+static BOOL FrameCacheLoad(CACHED_FRAMES *cache, int frame, FRAME frame_pixels)
+    {
+    if (cache->size[frame] == 0) return FALSE ;
+    RleDecode(frame_store + cache->offset[frame], frame_pixels[0], WIDTH*YSIZE) ;
+    return TRUE ;
     }
 
-static void ChromArtXferFrameBuffer(CLR_RGB32 *screen_pixels, FRAME frame_pixels)
+// PackBits run-length coding: a header byte h < 128 is followed by h + 1
+// literal bytes, and h > 128 by one byte to repeat 257 - h times. Returns
+// the size of the code, or -1 if it needs more than room bytes.
+static int RleEncode(const uint8_t *src, int count, uint8_t *dst, int room)
     {
-    DMA2D->NLR      = (WIDTH << 16) | HEIGHT ; 
+    int size = 0 ;
 
-    DMA2D->OMAR     = (uint32_t) (screen_pixels + XPIXELS*DISPLAY_YOFF + DISPLAY_XOFF) ;
-    DMA2D->OOR      = 0 ;   // Output row offset
-    DMA2D->OPFCCR   = 0 ;   // Output pixel format ARGB8888.
+    for (int i = 0; i < count;)
+        {
+        int run = 1, first = i ;
 
-    DMA2D->FGMAR    = (uint32_t) frame_pixels ; // foreground (source buffer) address.
-    DMA2D->FGOR     = 0 ;   // pixels rows are adjacent in source.
-    DMA2D->FGPFCCR  = 5 ;   // Source pixel format L8 (8 bits per pixel)
+        while (i + run < count && run < 128 && src[i + run] == src[i]) run++ ;
+        if (run >= 3)
+            {
+            if (size + 2 > room) return -1 ;
+            dst[size++] = 257 - run ;
+            dst[size++] = src[i] ;
+            i += run ;
+            continue ;
+            }
 
-    // Enable PFC (Pixel Format Conversion) and start transfer
-    DMA2D->CR       = 0x10001 ;
+        // Literals, up to the next run of three or more.
+        while (i < count && i - first < 128)
+            {
+            if (i + 2 < count && src[i] == src[i + 1] && src[i] == src[i + 2]) break ;
+            i++ ;
+            }
+        if (size + 1 + (i - first) > room) return -1 ;
+        dst[size++] = i - first - 1 ;
+        memcpy(&dst[size], &src[first], i - first) ;
+        size += i - first ;
+        }
+    return size ;
     }
 
-static void ChromArtWaitForDMA(void)
+static void RleDecode(const uint8_t *src, uint8_t *dst, int count)
     {
-    // wait until DMA transfer is finished
-    while ((DMA2D->CR & 1) != 0)
+    uint8_t * const end = dst + count ;
+
+    while (dst < end)
         {
-        // Poll no faster than once every microsecond
-        uint32_t timeout = GetClockCycleCount() + CPU_CLOCK_SPEED_MHZ ;
-        while ((int) (timeout - GetClockCycleCount()) > 0)
+        int header = *src++ ;
+
+        if (header < 128)
             {
-            if (Aborted()) return ;
+            memcpy(dst, src, header + 1) ;
+            src += header + 1 ;
+            dst += header + 1 ;
+            }
+        else
+            {
+            memset(dst, *src++, 257 - header) ;
+            dst += 257 - header ;
             }
         }
     }
+#endif
 
-static CLR_RGB32 PackRGB(int red, int grn, int blu)
+#ifdef GOVERNOR
+// Applies the governor's current quality level to a view; returns the
+// sample spacing to render it with.
+static int GovernorQuality(const FRAME_GOVERNOR *governor, VIEW *view)
     {
-#   define  BYTE(pixel)     ((uint8_t *) &pixel)
-    static uint32_t pixel = 0xFF000000 ;
+    const QUALITY *quality = &qualities[governor->level] ;
 
-    BYTE(pixel)[0] = blu ;
-    BYTE(pixel)[1] = grn ;
-    BYTE(pixel)[2] = red ;
-
-    return pixel ;
+    view->limit = quality->limit ;
+    return quality->step ;
     }
 
-static void PutChar(int x, int y, char ch, sFONT *font)
+// Called once a frame has been shown: drops a quality level if the frame
+// took more than 7/8 of its budget, and raises it again only when even the
+// worst case of the better level (every computed pixel running to its
+// limit) would take less than 3/4. Every GOVERNOR_REPORT_MSEC the frame
+// rate and quality are shown in the footer.
+static void GovernorUpdate(FRAME_GOVERNOR *governor, uint32_t start, uint32_t timeout)
     {
-    uint8_t *pline = BitmapAddress(ch, (uint8_t *) font->table, font->Height, font->Width) ;
-    for (int row = 0; row < font->Height; row++)
+    const QUALITY *quality = &qualities[governor->level] ;
+    uint32_t now = GetClockCycleCount() ;
+    uint32_t used = now - start ;
+    uint32_t budget = timeout - start ;
+    uint32_t elapsed ;
+
+    if (used > budget - budget/8)
         {
-        uint32_t bits = GetBitmapRow(pline) ;
-        for (int col = 0; col < font->Width; col++)
-            {
-            if ((int32_t) bits < 0) frame_pixels[y + row][x + col] = textColor ;
-            bits <<= 1 ;
-            }
-        pline += (font->Width + 7) / 8 ;
+        if (governor->level < (int) ITEMS(qualities) - 1) governor->level++ ;
+        }
+    else if (governor->level > 0)
+        {
+        const QUALITY *better = quality - 1 ;
+        float worst = (float) used * better->limit * (quality->step * quality->step)
+                    / (quality->limit * (better->step * better->step)) ;
+
+        if (worst < 0.75f * budget) governor->level-- ;
+        }
+
+    governor->frames++ ;
+    elapsed = now - governor->since ;
+    if (elapsed >= 1000 * GOVERNOR_REPORT_MSEC * CPU_CLOCK_SPEED_MHZ)
+        {
+        unsigned tenths = (unsigned) (10.0f * governor->frames * CPU_CLOCK_SPEED_MHZ * 1e6f / elapsed + 0.5f) ;
+        char text[100] ;
+
+        sprintf(text, "%u.%u fps, limit %u, step %u", tenths / 10, tenths % 10, quality->limit, quality->step) ;
+        DisplayFooter(text) ;
+        governor->frames = 0 ;
+        governor->since = now ;
         }
     }
+#endif
 
-static void PutString(int x, int y, char *str, sFONT *font)
+static void MandelbrotView(VIEW *view)
     {
-    while (*str != '\0')
+    const float X_ZOOM      = 1.30f ;
+    const float Y_ZOOM      = 0.75f ;
+    const float X_OFF       = -0.5f ;
+    const float Y_OFF       = 0.0f ;
+
+    view->pixel     = MandelbrotPixel ;
+    view->xctr      = TO_REAL(X_OFF) ;
+    view->yctr      = TO_REAL(Y_OFF) ;
+    view->dx        = TO_REAL(3.0f / (X_ZOOM * XSIZE)) ;
+    view->dy        = TO_REAL(2.0f / (Y_ZOOM * YSIZE)) ;
+    view->cx        = view->cy = TO_REAL(0.0f) ;
+    view->limit     = 18 ;
+    view->symmetry  = MIRROR_SYMMETRY ;
+    }
+
+static void JuliaView(VIEW *view, int degrees)
+    {
+    const float X_ZOOM      = 1.20f ;
+    const float Y_ZOOM      = 0.65f ;
+    const float X_OFF       = 0.0f ;
+    const float Y_OFF       = 0.0f ;
+    float radians = (degrees * 2 * (float) PI) / 360.0f ;
+
+    // This Julia set iterates z <-- -i*z^2 + p. Substituting w = -i*z
+    // turns that into w <-- w^2 - i*p, so JuliaPixel shares the Mandelbrot
+    // kernel with w = (zy, -zx) and c = (pY, -pX). Since z and -z have the
+    // same square, every Julia set is symmetric about the origin.
+    view->pixel     = JuliaPixel ;
+    view->xctr      = TO_REAL(X_OFF) ;
+    view->yctr      = TO_REAL(Y_OFF) ;
+    view->dx        = TO_REAL(3.0f / (X_ZOOM * XSIZE)) ;
+    view->dy        = TO_REAL(2.0f / (Y_ZOOM * YSIZE)) ;
+    view->cx        = TO_REAL(0.7885f * sinf(radians)) ;
+    view->cy        = TO_REAL(-0.7885f * cosf(radians)) ;
+    view->limit     = 50 ;
+    view->symmetry  = POINT_SYMMETRY ;
+    }
+
+#ifdef DEEP_ZOOM
+// Zooms in on c = i, a Misiurewicz point: the boundary there looks much
+// the same at every scale and the escape counts grow only slowly, so an
+// 8-bit iteration map still shows it 2^40 times deeper than the first
+// frame (where a float has long since run out of bits). Then starts over.
+static void MandelbrotZoomFractal(void)
+    {
+    CLR_INDEX colors[256] ;
+    char text[100] ;
+
+    FractalBackground("Mandelbrot Zoom") ;
+
+    aborted = FALSE ;
+    for (int steps = 0;; steps = (steps + 1) % DEEP_ZOOM_STEPS)
         {
-        PutChar(x, y, *str++, font) ;
-        x += font->Width ;
+        uint32_t timeout = GetTimeout(100) ;
+        DEEP_VIEW view ;
+        int references ;
+
+        DeepZoomView(&view, steps) ;
+        for (unsigned iter = 0; iter < view.limit; iter++)
+            {
+            colors[iter] = (4 * iter) % 255 ;
+            }
+        colors[view.limit] = 255 ;
+
+        if (!RenderPerturbed(&view, mandelbrot_map, &references)) return ;
+        RemapIterations(mandelbrot_map, colors, frame_pixels) ;
+        PresentFrame() ;
+
+        sprintf(text, "zoom 2^%d, limit %u, %d reference%s",
+            steps / 4, view.limit, references, references == 1 ? "" : "s") ;
+        DisplayFooter(text) ;
+        WaitForTimeout(timeout) ;
+        if (aborted) return ;
         }
     }
 
-static void TextColor(CLR_INDEX color)
+// The view after zooming in by 2^(1/4) the given number of times, with
+// an iteration limit that grows with the depth.
+static void DeepZoomView(DEEP_VIEW *view, int steps)
     {
-    textColor = color ;
+    const float X_ZOOM      = 1.30f ;
+    const float Y_ZOOM      = 0.75f ;
+    float scale = exp2f(-0.25f * steps) ;
+
+    view->xctr      = 0.0 ;
+    view->yctr      = 1.0 ;
+    view->dx        = scale * 3.0f / (X_ZOOM * XSIZE) ;
+    view->dy        = scale * 2.0f / (Y_ZOOM * YSIZE) ;
+    view->limit     = 64 + steps ;
+    if (view->limit > ITERS_UNKNOWN - 1) view->limit = ITERS_UNKNOWN - 1 ;
     }
 
-static void FractalTitle(char *title)
+// Fills the map by perturbation. The first reference orbit is that of the
+// center; each pixel is then iterated as a float offset from it, which is
+// cheap at any depth. A pixel whose offset grows to the size of the orbit
+// itself has lost its precision (a glitch) and is left unknown, and the
+// first such pixel becomes the next reference, for the unknown pixels
+// only. Whatever is left after DEEP_REFERENCES orbits is computed directly
+// in double precision. Returns FALSE if the push button interrupted it.
+static BOOL RenderPerturbed(const DEEP_VIEW *view, ITERS *map, int *references)
     {
-    int width, xpos, ypos ;
-    sFONT * const font = &Font16 ;
+    int xref = XSIZE/2, yref = YSIZE/2 ;
 
-    TextColor(INDEX_YLW) ;
-    width = strlen(title) * font->Width ;
-    xpos = (XSIZE - width) / 2 ;
-    ypos = HEIGHT - font->Height ;
-    PutString(xpos, ypos, title, font) ;
+    memset(map, ITERS_UNKNOWN, sizeof(ITERS)) ;
+    for (*references = 1; *references <= DEEP_REFERENCES; ++*references)
+        {
+        unsigned glitches = 0 ;
+        int xnext = 0, ynext = 0 ;
+
+        ReferenceOrbit(view->xctr + (double) ((xref - XSIZE/2) * view->dx),
+                       view->yctr + (double) ((yref - YSIZE/2) * view->dy),
+                       view->limit, &reference) ;
+        for (int y = 0; y < YSIZE; y++)
+            {
+            uint8_t *iters = (*map)[y] ;
+
+            for (int x = 0; x < XSIZE; x++)
+                {
+                if (iters[x] != ITERS_UNKNOWN) continue ;
+                iters[x] = PerturbedPixel(&reference, (x - xref) * view->dx, (y - yref) * view->dy, view->limit) ;
+                if (iters[x] == ITERS_UNKNOWN && glitches++ == 0)
+                    {
+                    xnext = x ; ynext = y ;
+                    }
+                }
+            if (Aborted()) return FALSE ;
+            }
+        if (glitches == 0) return TRUE ;
+        xref = xnext ; yref = ynext ;
+        }
+
+    *references = DEEP_REFERENCES ;
+    for (int y = 0; y < YSIZE; y++)
+        {
+        for (int x = 0; x < XSIZE; x++)
+            {
+            double px = view->xctr + (double) ((x - XSIZE/2) * view->dx) ;
+            double py = view->yctr + (double) ((y - YSIZE/2) * view->dy) ;
+
+            if ((*map)[y][x] == ITERS_UNKNOWN) (*map)[y][x] = EscapeTimeDouble(0.0, 0.0, px, py, view->limit) ;
+            }
+        if (Aborted()) return FALSE ;
+        }
+    return TRUE ;
+    }
+
+static void ReferenceOrbit(double cx, double cy, unsigned limit, ORBIT *orbit)
+    {
+    double zx = 0.0, zy = 0.0 ;
+    unsigned n ;
+
+    for (n = 0; n < limit; n++)
+        {
+        double zxSquared = zx*zx ;
+        double zySquared = zy*zy ;
+
+        orbit->zx[n] = (float) zx ;
+        orbit->zy[n] = (float) zy ;
+        if (zxSquared + zySquared > 4.0) break ;
+
+        zy = cy + 2.0*zx*zy ;
+        zx = cx + zxSquared - zySquared ;
+        }
+    orbit->length = n ;
+    }
+
+// Escape count of the point dc away from the reference, iterating only
+// its offset from the reference orbit: z = Z + dz, and since Z' = Z^2 + C,
+// dz' = 2*Z*dz + dz^2 + dc. Returns ITERS_UNKNOWN for a glitch, which is
+// also what a pixel still going when the reference orbit escaped is.
+static unsigned PerturbedPixel(const ORBIT *orbit, float dcx, float dcy, unsigned limit)
+    {
+    float dzx = 0.0f, dzy = 0.0f ;
+
+    for (unsigned n = 0; n < limit; n++)
+        {
+        float zx, zy, magnitude ;
+        float newX ;
+
+        if (n >= orbit->length) return ITERS_UNKNOWN ;
+        zx = orbit->zx[n] + dzx ;
+        zy = orbit->zy[n] + dzy ;
+        magnitude = zx*zx + zy*zy ;
+        if (magnitude > 4.0f) return n ;
+        if (magnitude < DEEP_GLITCH * (orbit->zx[n]*orbit->zx[n] + orbit->zy[n]*orbit->zy[n]))
+            {
+            return ITERS_UNKNOWN ;
+            }
+
+        newX = 2.0f*(orbit->zx[n]*dzx - orbit->zy[n]*dzy) + dzx*dzx - dzy*dzy + dcx ;
+        dzy  = 2.0f*(orbit->zx[n]*dzy + orbit->zy[n]*dzx) + 2.0f*dzx*dzy + dcy ;
+        dzx  = newX ;
+        }
+
+    return limit ;
+    }
+#endif
+
+// Escape count of one Mandelbrot pixel, skipping the iteration entirely
+// for points that are known to be inside the set.
+static unsigned MandelbrotPixel(const VIEW *view, int x, int y)
+    {
+    REAL px = VIEW_X(view, x) ;
+    REAL py = VIEW_Y(view, y) ;
+
+    if (InsideMainBulbs(TO_FLOAT(px), TO_FLOAT(py)))
+        {
+        COUNT_FAST_PATH(bulbs) ;
+        return view->limit ;
+        }
+
+    return EscapeTime(px, py, px, py, view->limit) ;
+    }
+
+static unsigned JuliaPixel(const VIEW *view, int x, int y)
+    {
+    return EscapeTime(VIEW_Y(view, y), -VIEW_X(view, x), view->cx, view->cy, view->limit) ;
+    }
+
+// Analytic membership tests for the main cardioid and the period-2 bulb,
+// which together hold most of the set's interior.
+static BOOL InsideMainBulbs(float px, float py)
+    {
+    float pySquared = py*py ;
+    float xq = px - 0.25f ;
+    float q = xq*xq + pySquared ;
+
+    if (q*(q + xq) <= 0.25f*pySquared) return TRUE ;
+    return (px + 1.0f)*(px + 1.0f) + pySquared <= 0.0625f ;
+    }
+
+// Row whose escape counts are the reflection of row y across the real
+// axis (or through the origin), or -1 if there is no such row above y.
+static int MirrorRow(const VIEW *view, int y)
+    {
+    int mirror ;
+
+    if (view->symmetry == NO_SYMMETRY) return -1 ;
+    mirror = YSIZE - y - (int) (2.0f * TO_FLOAT(view->yctr) / TO_FLOAT(view->dy)) ;
+    if (mirror < 0 || mirror >= y) return -1 ;
+    if (VIEW_Y(view, mirror) != -VIEW_Y(view, y)) return -1 ;
+    return mirror ;
+    }
+
+// Copies every row from first on that mirrors an earlier one. Under point
+// symmetry the row is also reversed; a pixel whose reflected column is off
+// the map, or not exactly at -x, is computed instead.
+static void MirrorRows(const VIEW *view, ITERS *map, int first)
+    {
+    int xoff = (int) (2.0f * TO_FLOAT(view->xctr) / TO_FLOAT(view->dx)) ;
+
+    for (int y = first; y < YSIZE; y++)
+        {
+        int mirror = MirrorRow(view, y) ;
+
+        if (mirror < 0) continue ;
+        if (view->symmetry == MIRROR_SYMMETRY)
+            {
+            memcpy((*map)[y], (*map)[mirror], XSIZE) ;
+            fast_paths.mirrored += XSIZE ;
+            continue ;
+            }
+
+        for (int x = 0; x < XSIZE; x++)
+            {
+            int xm = XSIZE - x - xoff ;
+
+            if (0 <= xm && xm < XSIZE && VIEW_X(view, xm) == -VIEW_X(view, x))
+                {
+                (*map)[y][x] = (*map)[mirror][xm] ;
+                fast_paths.mirrored++ ;
+                }
+            else (*map)[y][x] = (*view->pixel)(view, x, y) ;
+            }
+        }
+    }
+
+// Raster-order renderer: computes every pixel that is not a mirror image.
+// Returns FALSE if the push button interrupted it.
+static BOOL __attribute__((unused)) RenderRaster(const VIEW *view, ITERS *map)
+    {
+    for (int y = 0; y < YSIZE; y++)
+        {
+        if (MirrorRow(view, y) >= 0) continue ;
+
+        for (int x = 0; x < XSIZE; x++)
+            {
+            (*map)[y][x] = (*view->pixel)(view, x, y) ;
+            }
+
+        if (Aborted()) return FALSE ;
+        }
+
+    MirrorRows(view, map, 0) ;
+    return TRUE ;
+    }
+
+// RenderRaster with EscapeKernel() computing a row at a time. It always
+// iterates in single precision and, unlike MandelbrotPixel, does not skip
+// the main cardioid and bulb.
+static BOOL __attribute__((unused)) RenderVector(const VIEW *view, ITERS *map)
+    {
+    static float zx[XSIZE], zy[XSIZE], cx[XSIZE], cy[XSIZE] ;
+    const ESCAPE_KERNEL *kernel = EscapeKernel() ;
+
+    for (int y = 0; y < YSIZE; y++)
+        {
+        if (MirrorRow(view, y) >= 0) continue ;
+
+        ViewOrbits(view, y, zx, zy, cx, cy) ;
+        (*kernel->row)(zx, zy, cx, cy, view->limit, (*map)[y], XSIZE) ;
+
+        if (Aborted()) return FALSE ;
+        }
+
+    MirrorRows(view, map, 0) ;
+    return TRUE ;
+    }
+
+// Where the orbit of each pixel in row y starts, and its constant, as
+// MandelbrotPixel and JuliaPixel pass them to EscapeTime.
+static void ViewOrbits(const VIEW *view, int y, float zx[], float zy[], float cx[], float cy[])
+    {
+    for (int x = 0; x < XSIZE; x++)
+        {
+        float px = TO_FLOAT(VIEW_X(view, x)) ;
+        float py = TO_FLOAT(VIEW_Y(view, y)) ;
+
+        if (view->pixel == JuliaPixel)
+            {
+            zx[x] = py ;
+            zy[x] = -px ;
+            cx[x] = TO_FLOAT(view->cx) ;
+            cy[x] = TO_FLOAT(view->cy) ;
+            }
+        else
+            {
+            zx[x] = cx[x] = px ;
+            zy[x] = cy[x] = py ;
+            }
+        }
+    }
+
+// Mariani-Silver renderer: computes the border of a rectangle and, if every
+// border pixel has the same escape count, fills the inside with it without
+// iterating; otherwise the rectangle is split in two across its longer side
+// (the halves share the dividing line) and each half is handled the same
+// way. Pending rectangles live on a small fixed stack; when it is full the
+// rectangle is simply computed pixel by pixel. Returns FALSE if the push
+// button interrupted it. The result is only approximate: a border of one
+// escape count can enclose pixels of another (a small copy of the set in a
+// band, say), and those are filled over. RECT_MIN_SIZE makes that rare but
+// not impossible, which is why RenderRaster is the default.
+static BOOL __attribute__((unused)) RenderSubdivided(const VIEW *view, ITERS *map)
+    {
+    int rows = RowsToCompute(view) ;
+
+    memset(map, ITERS_UNKNOWN, sizeof(ITERS)) ;
+    if (!SubdivideRows(view, map, rows)) return FALSE ;
+    MirrorRows(view, map, rows) ;
+    return TRUE ;
+    }
+
+// Number of rows above the mirrored tail: the only ones to be computed.
+static int RowsToCompute(const VIEW *view)
+    {
+    int rows ;
+
+    for (rows = YSIZE; rows > 0 && MirrorRow(view, rows - 1) >= 0; rows--) ;
+    return rows ;
+    }
+
+// The subdivision of RenderSubdivided over the first rows of the map.
+// Escape counts already in the map are used rather than recomputed.
+static BOOL SubdivideRows(const VIEW *view, ITERS *map, int rows)
+    {
+    RECT stack[RECT_STACK_DEPTH] ;
+    int depth ;
+
+    stack[0].x0 = 0 ; stack[0].x1 = XSIZE - 1 ;
+    stack[0].y0 = 0 ; stack[0].y1 = rows - 1 ;
+    depth = 1 ;
+
+    while (depth > 0)
+        {
+        RECT r = stack[--depth] ;
+        uint8_t iter ;
+        BOOL uniform ;
+
+        if (Aborted()) return FALSE ;
+
+        iter = MapPixel(view, map, r.x0, r.y0) ;
+        uniform = TRUE ;
+        for (int x = r.x0; x <= r.x1; x++)
+            {
+            if (MapPixel(view, map, x, r.y0) != iter) uniform = FALSE ;
+            if (MapPixel(view, map, x, r.y1) != iter) uniform = FALSE ;
+            }
+        for (int y = r.y0 + 1; y < r.y1; y++)
+            {
+            if (MapPixel(view, map, r.x0, y) != iter) uniform = FALSE ;
+            if (MapPixel(view, map, r.x1, y) != iter) uniform = FALSE ;
+            }
+
+        if (r.x1 - r.x0 < 2 || r.y1 - r.y0 < 2) continue ;     // no inside
+
+        if (uniform)
+            {
+            for (int y = r.y0 + 1; y < r.y1; y++)
+                {
+                memset(&(*map)[y][r.x0 + 1], iter, r.x1 - r.x0 - 1) ;
+                }
+            fast_paths.filled += (r.x1 - r.x0 - 1) * (r.y1 - r.y0 - 1) ;
+            }
+        else if (r.x1 - r.x0 < RECT_MIN_SIZE || r.y1 - r.y0 < RECT_MIN_SIZE || depth + 2 > RECT_STACK_DEPTH)
+            {
+            for (int y = r.y0 + 1; y < r.y1; y++)
+                {
+                for (int x = r.x0 + 1; x < r.x1; x++) MapPixel(view, map, x, y) ;
+                }
+            }
+        else if (r.x1 - r.x0 >= r.y1 - r.y0)
+            {
+            int mid = (r.x0 + r.x1) / 2 ;
+
+            stack[depth] = r ; stack[depth++].x1 = mid ;
+            stack[depth] = r ; stack[depth++].x0 = mid ;
+            }
+        else
+            {
+            int mid = (r.y0 + r.y1) / 2 ;
+
+            stack[depth] = r ; stack[depth++].y1 = mid ;
+            stack[depth] = r ; stack[depth++].y0 = mid ;
+            }
+        }
+
+    return TRUE ;
+    }
+
+#ifdef PARALLEL
+// Renders the rows above the mirrored tail as TILE_SIZE square tiles on
+// worker threads (see Host/parallel.h), which steal tiles from each other
+// as the escape-time cost of their own turns out to differ. Only this
+// thread, which works on tiles too, looks at the push button (the run-time
+// is not thread-safe); it does so every row, and the others then drop the
+// tiles they have left.
+static BOOL __attribute__((unused)) RenderTiled(const VIEW *view, ITERS *map)
+    {
+    TILING tiling = {view, map, RowsToCompute(view), FALSE} ;
+    int tiles = TILE_COLS * ((tiling.rows + TILE_SIZE - 1) / TILE_SIZE) ;
+
+    tile_caller = TRUE ;
+    HostParallelFor(tiles, tile_threads > 0 ? tile_threads : HostCpuCount(), RenderTile, &tiling) ;
+    tile_caller = FALSE ;
+    if (tiling.stop) return FALSE ;
+
+    MirrorRows(view, map, tiling.rows) ;
+    return !Aborted() ;
+    }
+
+static void RenderTile(void *arg, int tile)
+    {
+    TILING *tiling = (TILING *) arg ;
+    int x0 = (tile % TILE_COLS) * TILE_SIZE ;
+    int y0 = (tile / TILE_COLS) * TILE_SIZE ;
+    int x1 = x0 + TILE_SIZE < XSIZE ? x0 + TILE_SIZE : XSIZE ;
+    int y1 = y0 + TILE_SIZE < tiling->rows ? y0 + TILE_SIZE : tiling->rows ;
+
+    for (int y = y0; y < y1; y++)
+        {
+        if (tile_caller && Aborted()) __atomic_store_n(&tiling->stop, TRUE, __ATOMIC_RELAXED) ;
+        if (__atomic_load_n(&tiling->stop, __ATOMIC_RELAXED)) return ;
+
+        for (int x = x0; x < x1; x++)
+            {
+            (*tiling->map)[y][x] = (*tiling->view->pixel)(tiling->view, x, y) ;
+            }
+        }
+    }
+#endif
+
+#ifdef PROGRESSIVE
+// Coarse-to-fine renderer: samples every PROGRESSIVE_STEP-th pixel of every
+// PROGRESSIVE_STEP-th row, then halves the step pass after pass, each pass
+// computing only the samples the earlier ones did not; the last pass is the
+// subdivision of RenderSubdivided, which reuses them all and, like it, is
+// approximate. Without a timeout every coarse pass is shown, each sample
+// standing for its block. With one, a pass is shown only if the next
+// (three times as many new samples as all before it) would not finish in
+// time, and refinement stops there. Returns the step of the last pass
+// completed (1 when the map is complete, but not yet shown), or 0 if the
+// push button interrupted it.
+static int RenderProgressive(const VIEW *view, ITERS *map, const CLR_INDEX colors[], const uint32_t *timeout)
+    {
+    uint32_t start = GetClockCycleCount() ;
+    int rows = RowsToCompute(view) ;
+
+    memset(map, ITERS_UNKNOWN, sizeof(ITERS)) ;
+    for (int step = PROGRESSIVE_STEP; step > 1; step /= 2)
+        {
+        uint32_t now ;
+
+        if (!SampleGrid(view, map, step, rows)) return 0 ;
+
+        now = GetClockCycleCount() ;
+        if (timeout == NULL || (int) (*timeout - now) < (int) (3 * (now - start)))
+            {
+            RemapBlocks(view, map, colors, frame_pixels, step, rows) ;
+            PresentFrame() ;
+            if (timeout != NULL) return step ;
+            }
+        }
+
+    if (!SubdivideRows(view, map, rows)) return 0 ;
+    MirrorRows(view, map, rows) ;
+    return 1 ;
+    }
+#endif
+
+#ifdef GOVERNOR
+// Renders and shows a view at reduced resolution: only every step-th pixel
+// of every step-th row is computed, each standing for its block.
+static BOOL RenderSampled(const VIEW *view, ITERS *map, const CLR_INDEX colors[], int step)
+    {
+    int rows = RowsToCompute(view) ;
+
+    memset(map, ITERS_UNKNOWN, sizeof(ITERS)) ;
+    if (!SampleGrid(view, map, step, rows)) return FALSE ;
+    RemapBlocks(view, map, colors, frame_pixels, step, rows) ;
+    PresentFrame() ;
+    return TRUE ;
+    }
+#endif
+
+#if defined(PROGRESSIVE) || defined(GOVERNOR)
+// Computes the samples on a grid of the given step that are not yet known.
+static BOOL SampleGrid(const VIEW *view, ITERS *map, int step, int rows)
+    {
+    for (int y = 0; y < rows; y += step)
+        {
+        for (int x = 0; x < XSIZE; x += step) MapPixel(view, map, x, y) ;
+        if (Aborted()) return FALSE ;
+        }
+    return TRUE ;
+    }
+#endif
+
+#ifdef SELF_TEST
+// Renders the Mandelbrot view and every frame of the Julia animation with
+// both renderers and reports any pixel where their escape counts differ:
+// how far the approximation of RenderSubdivided strays on these views.
+static BOOL RenderersAgree(void)
+    {
+    unsigned diffs[2] ;
+    char text[100] ;
+    int row ;
+
+    diffs[0] = diffs[1] = 0 ;
+    for (int degrees = -3; degrees < 360; degrees += 3)
+        {
+        const uint8_t *raster = (*mandelbrot_map)[0] ;
+        const uint8_t *subdiv = (*julia_map)[0] ;
+        VIEW view ;
+
+        if (degrees < 0) MandelbrotView(&view) ;
+        else JuliaView(&view, degrees) ;
+        RenderRaster(&view, mandelbrot_map) ;
+        RenderSubdivided(&view, julia_map) ;
+        for (int pixel = 0; pixel < XSIZE*YSIZE; pixel++)
+            {
+            if (raster[pixel] != subdiv[pixel]) diffs[degrees >= 0]++ ;
+            }
+        }
+
+    ClearDisplay() ;
+    row = Y_MIN ;
+    sprintf(text, "Mandelbrot diffs: %u", diffs[0]) ;
+    DisplayStringAt(0, row, text) ;
+    row += Font16.Height ;
+    sprintf(text, "     Julia diffs: %u", diffs[1]) ;
+    DisplayStringAt(0, row, text) ;
+
+    LEDs(diffs[0] + diffs[1] == 0, diffs[0] + diffs[1] != 0) ;
+    WaitForPushButton() ;
+    return diffs[0] + diffs[1] == 0 ;
+    }
+#endif
+
+#if defined(SELF_TEST) && defined(LTDC_EMULATED)
+// Shows the Mandelbrot set at several color offsets both ways: remapped
+// and converted by the DMA2D, and remapped once and scanned out by the
+// emulated LTDC through a rotated CLUT. Reports any pixel that differs.
+static BOOL ScanoutAgrees(void)
+    {
+    CLR_RGB32 * const scanned = (CLR_RGB32 *) SDRAM_SCRATCH ;
+    const CLR_RGB32 *converted = screen_pixels + XPIXELS*DISPLAY_YOFF + DISPLAY_XOFF ;
+    CLR_INDEX colors[256] ;
+    unsigned diffs ;
+    char text[100] ;
+    VIEW view ;
+
+    MandelbrotView(&view) ;
+    RenderRaster(&view, mandelbrot_map) ;
+
+    diffs = 0 ;
+    for (int clroff = 0; clroff < 255; clroff += 85)
+        {
+        for (unsigned iter = 0; iter < view.limit; iter++)
+            {
+            colors[iter] = (clroff + (255*iter)/view.limit) % 255 ;
+            }
+        colors[view.limit] = 255 ;
+        RemapIterations(mandelbrot_map, colors, frames[0]) ;
+        ChromArtWaitForDMA(ChromArtXferFrameBuffer(screen_pixels, frames[0], NULL)) ;
+
+        for (unsigned iter = 0; iter < view.limit; iter++)
+            {
+            colors[iter] = (255*iter)/view.limit ;
+            }
+        RemapIterations(mandelbrot_map, colors, frames[1]) ;
+        LtdcLoadClut(clroff) ;
+        LtdcShowFrame(frames[1]) ;
+        LtdcScanout(scanned) ;
+
+        for (int y = 0; y < YSIZE; y++)
+            {
+            for (int x = 0; x < WIDTH; x++)
+                {
+                if (((converted[y*XPIXELS + x] ^ scanned[y*WIDTH + x]) & 0x00FFFFFF) != 0) diffs++ ;
+                }
+            }
+        }
+    LtdcLoadClut(0) ;
+
+    ClearDisplay() ;
+    sprintf(text, "LTDC scanout diffs: %u", diffs) ;
+    DisplayStringAt(0, Y_MIN, text) ;
+    LEDs(diffs == 0, diffs != 0) ;
+    WaitForPushButton() ;
+    return diffs == 0 ;
+    }
+#endif
+
+// Escape count at (x, y), computed on first use.
+static uint8_t MapPixel(const VIEW *view, ITERS *map, int x, int y)
+    {
+    uint8_t *pitr = &(*map)[y][x] ;
+
+    if (*pitr == ITERS_UNKNOWN) *pitr = (*view->pixel)(view, x, y) ;
+    return *pitr ;
+    }
+
+// Converts escape counts to color indices in a single pass.
+static void RemapIterations(ITERS *map, const CLR_INDEX colors[], FRAME frame_pixels)
+    {
+    for (int y = 0; y < YSIZE; y++)
+        {
+        const uint8_t *iters = (*map)[y] ;
+        CLR_INDEX *pixels = frame_pixels[y] ;
+
+        for (int x = 0; x < XSIZE; x++) pixels[x] = colors[iters[x]] ;
+        }
+    }
+
+#if defined(PROGRESSIVE) || defined(GOVERNOR)
+// RemapIterations for a map in which only the samples on a grid of the
+// given step (and only in its first rows) are known: every pixel takes the
+// color of the sample at the top left of its block, and each mirrored row
+// that of the block it is the reflection of.
+static void RemapBlocks(const VIEW *view, ITERS *map, const CLR_INDEX colors[], FRAME frame_pixels, int step, int rows)
+    {
+    int xoff = (int) (2.0f * TO_FLOAT(view->xctr) / TO_FLOAT(view->dx)) ;
+
+    for (int y = 0; y < YSIZE; y++)
+        {
+        int ys = (y < rows) ? y : MirrorRow(view, y) ;
+        BOOL reversed = (y >= rows && view->symmetry == POINT_SYMMETRY) ;
+        const uint8_t *iters = (*map)[ys - ys % step] ;
+        CLR_INDEX *pixels = frame_pixels[y] ;
+
+        for (int x = 0; x < XSIZE; x++)
+            {
+            int xs = x ;
+
+            if (reversed)
+                {
+                xs = XSIZE - x - xoff ;
+                if (xs < 0) xs = 0 ;
+                if (xs >= XSIZE) xs = XSIZE - 1 ;
+                }
+            pixels[x] = colors[iters[xs - xs % step]] ;
+            }
+        }
+    }
+#endif
+
+// Escape-time kernels: iterate z <-- z^2 + c until |z| > 2, returning the
+// number of iterations completed (limit if z never escapes). Interior
+// orbits settle into an exact cycle, so each kernel also compares z with a
+// saved point that is refreshed at power-of-two iterations (Brent) and
+// gives up as soon as z repeats. The precision policy calls one of them
+// as EscapeTime; the others stay for the kernel benchmark and deep zoom.
+static unsigned __attribute__((unused)) EscapeTimeFloat(float zx, float zy, float cx, float cy, unsigned limit)
+    {
+    float savedX = zx, savedY = zy ;
+    unsigned iter, check = 1 ;
+
+    for (iter = 0; iter < limit; iter++)
+        {
+        float zxSquared = zx*zx ;
+        float zySquared = zy*zy ;
+
+        if (zxSquared + zySquared > 4.0f) break ;
+
+        zy = cy + 2.0f*zx*zy ;
+        zx = cx + zxSquared - zySquared ;
+
+        if (zx == savedX && zy == savedY)
+            {
+            COUNT_FAST_PATH(periodic) ;
+            return limit ;
+            }
+        if (iter == check)
+            {
+            savedX = zx ; savedY = zy ;
+            check <<= 1 ;
+            }
+        }
+
+    return iter ;
+    }
+
+static unsigned __attribute__((unused)) EscapeTimeDouble(double zx, double zy, double cx, double cy, unsigned limit)
+    {
+    double savedX = zx, savedY = zy ;
+    unsigned iter, check = 1 ;
+
+    for (iter = 0; iter < limit; iter++)
+        {
+        double zxSquared = zx*zx ;
+        double zySquared = zy*zy ;
+
+        if (zxSquared + zySquared > 4.0) break ;
+
+        zy = cy + 2.0*zx*zy ;
+        zx = cx + zxSquared - zySquared ;
+
+        if (zx == savedX && zy == savedY)
+            {
+            COUNT_FAST_PATH(periodic) ;
+            return limit ;
+            }
+        if (iter == check)
+            {
+            savedX = zx ; savedY = zy ;
+            check <<= 1 ;
+            }
+        }
+
+    return iter ;
+    }
+
+// Q4.28 operands (range -8..+8). The squares are kept as Q8.24, the upper
+// word of the 64-bit product (SMMUL), so |z|^2 cannot overflow before the
+// escape test; 2*zx*zy comes back to Q4.28 from the full product (SMULL).
+static unsigned __attribute__((unused)) EscapeTimeQ28(int32_t zx, int32_t zy, int32_t cx, int32_t cy, unsigned limit)
+    {
+    int32_t savedX = zx, savedY = zy ;
+    unsigned iter, check = 1 ;
+
+    for (iter = 0; iter < limit; iter++)
+        {
+        int32_t zxSquared = (int32_t) (((int64_t) zx * zx) >> 32) ;
+        int32_t zySquared = (int32_t) (((int64_t) zy * zy) >> 32) ;
+
+        if (zxSquared + zySquared > Q24(4.0f)) break ;
+
+        zy = cy + (int32_t) (((int64_t) zx * zy) >> 27) ;
+        zx = cx + (zxSquared - zySquared) * 16 ;
+
+        if (zx == savedX && zy == savedY)
+            {
+            COUNT_FAST_PATH(periodic) ;
+            return limit ;
+            }
+        if (iter == check)
+            {
+            savedX = zx ; savedY = zy ;
+            check <<= 1 ;
+            }
+        }
+
+    return iter ;
+    }
+
+// The widest row kernel that this CPU supports, chosen on first use: SSE2
+// (4 lanes) or AVX2 (8 lanes) on an x86 host, else (as on the Cortex-M4,
+// which has no floating-point SIMD) EscapeRowScalar.
+static const ESCAPE_KERNEL *EscapeKernel(void)
+    {
+    static const ESCAPE_KERNEL *best = NULL ;
+
+    if (best == NULL)
+        {
+        for (int k = 0; k < (int) ITEMS(escape_kernels); k++)
+            {
+            if (EscapeKernelSupported(&escape_kernels[k])) best = &escape_kernels[k] ;
+            }
+        }
+    return best ;
+    }
+
+static BOOL EscapeKernelSupported(const ESCAPE_KERNEL *kernel)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init() ;
+    if (kernel->row == EscapeRowAVX2) return __builtin_cpu_supports("avx2") != 0 ;
+    if (kernel->row == EscapeRowSSE2) return __builtin_cpu_supports("sse2") != 0 ;
+#endif
+    return TRUE ;
+    }
+
+static void EscapeRowScalar(const float zx[], const float zy[], const float cx[], const float cy[], unsigned limit, uint8_t iters[], int count)
+    {
+    for (int i = 0; i < count; i++)
+        {
+        iters[i] = EscapeTimeFloat(zx[i], zy[i], cx[i], cy[i], limit) ;
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+// EscapeTimeFloat on four orbits at once, in the same order of operations
+// so that the counts are identical. A lane stops counting once its orbit
+// has escaped (and stays masked off even if it overflows to NaN); the loop
+// ends when every lane has. There is no cycle check: an orbit that repeats
+// never escapes, so it counts to the limit anyway. The last count % 4
+// orbits are left to EscapeRowScalar.
+__attribute__((target("sse2")))
+static void EscapeRowSSE2(const float zx[], const float zy[], const float cx[], const float cy[], unsigned limit, uint8_t iters[], int count)
+    {
+    const __m128 two = _mm_set1_ps(2.0f), four = _mm_set1_ps(4.0f) ;
+    int i ;
+
+    for (i = 0; i + 4 <= count; i += 4)
+        {
+        __m128 x = _mm_loadu_ps(&zx[i]), y = _mm_loadu_ps(&zy[i]) ;
+        __m128 a = _mm_loadu_ps(&cx[i]), b = _mm_loadu_ps(&cy[i]) ;
+        __m128 alive = _mm_castsi128_ps(_mm_set1_epi32(-1)) ;
+        __m128i counts = _mm_setzero_si128() ;
+        int32_t lanes[4] ;
+
+        for (unsigned iter = 0; iter < limit; iter++)
+            {
+            __m128 xSquared = _mm_mul_ps(x, x) ;
+            __m128 ySquared = _mm_mul_ps(y, y) ;
+
+            alive = _mm_and_ps(alive, _mm_cmple_ps(_mm_add_ps(xSquared, ySquared), four)) ;
+            if (_mm_movemask_ps(alive) == 0) break ;
+            counts = _mm_sub_epi32(counts, _mm_castps_si128(alive)) ;
+
+            y = _mm_add_ps(b, _mm_mul_ps(_mm_mul_ps(two, x), y)) ;
+            x = _mm_sub_ps(_mm_add_ps(a, xSquared), ySquared) ;
+            }
+
+        _mm_storeu_si128((__m128i *) lanes, counts) ;
+        for (int k = 0; k < 4; k++) iters[i + k] = lanes[k] ;
+        }
+    EscapeRowScalar(&zx[i], &zy[i], &cx[i], &cy[i], limit, &iters[i], count - i) ;
+    }
+
+// EscapeRowSSE2 with eight lanes.
+__attribute__((target("avx2")))
+static void EscapeRowAVX2(const float zx[], const float zy[], const float cx[], const float cy[], unsigned limit, uint8_t iters[], int count)
+    {
+    const __m256 two = _mm256_set1_ps(2.0f), four = _mm256_set1_ps(4.0f) ;
+    int i ;
+
+    for (i = 0; i + 8 <= count; i += 8)
+        {
+        __m256 x = _mm256_loadu_ps(&zx[i]), y = _mm256_loadu_ps(&zy[i]) ;
+        __m256 a = _mm256_loadu_ps(&cx[i]), b = _mm256_loadu_ps(&cy[i]) ;
+        __m256 alive = _mm256_castsi256_ps(_mm256_set1_epi32(-1)) ;
+        __m256i counts = _mm256_setzero_si256() ;
+        int32_t lanes[8] ;
+
+        for (unsigned iter = 0; iter < limit; iter++)
+            {
+            __m256 xSquared = _mm256_mul_ps(x, x) ;
+            __m256 ySquared = _mm256_mul_ps(y, y) ;
+
+            alive = _mm256_and_ps(alive, _mm256_cmp_ps(_mm256_add_ps(xSquared, ySquared), four, _CMP_LE_OQ)) ;
+            if (_mm256_movemask_ps(alive) == 0) break ;
+            counts = _mm256_sub_epi32(counts, _mm256_castps_si256(alive)) ;
+
+            y = _mm256_add_ps(b, _mm256_mul_ps(_mm256_mul_ps(two, x), y)) ;
+            x = _mm256_sub_ps(_mm256_add_ps(a, xSquared), ySquared) ;
+            }
+
+        _mm256_storeu_si256((__m256i *) lanes, counts) ;
+        for (int k = 0; k < 8; k++) iters[i + k] = lanes[k] ;
+        }
+    EscapeRowScalar(&zx[i], &zy[i], &cx[i], &cy[i], limit, &iters[i], count - i) ;
+    }
+#endif
+
+#ifdef BENCHMARK
+// Renders the Mandelbrot set once with each kernel at several zoom levels
+// around a boundary point and reports cycles per pixel, along with the
+// number of pixels whose iteration count differs from the double kernel.
+static void BenchmarkKernels(void)
+    {
+    static const float zooms[] = {1.0f, 1e2f, 1e4f, 1e6f} ;
+    const unsigned limit    = 50 ;
+    const double X_CTR      = -0.743643887 ;
+    const double Y_CTR      = 0.131825904 ;
+    char text[100] ;
+    int row ;
+
+    ClearDisplay() ;
+    row = Y_MIN ;
+    DisplayStringAt(0, row, "Zoom    Float  Q4.28  Double") ;
+    row += 2 * Font16.Height ;
+
+    for (int z = 0; z < (int) ITEMS(zooms); z++)
+        {
+        double dx = 3.0 / (1.30 * zooms[z] * XSIZE) ;
+        double dy = 2.0 / (0.75 * zooms[z] * YSIZE) ;
+        double xmin = X_CTR - (XSIZE/2) * dx ;
+        double ymin = Y_CTR - (YSIZE/2) * dy ;
+        uint32_t cycles[3] ;
+        unsigned diffs[2] ;
+
+        cycles[0] = cycles[1] = cycles[2] = 0 ;
+        diffs[0] = diffs[1] = 0 ;
+        for (int y = 0; y < YSIZE; y++)
+            {
+            for (int x = 0; x < XSIZE; x++)
+                {
+                double px = xmin + x * dx ;
+                double py = ymin + y * dy ;
+                float fx = (float) px, fy = (float) py ;
+                int32_t qx = Q28(fx), qy = Q28(fy) ;
+                unsigned iter[3] ;
+                uint32_t start ;
+
+                start = GetClockCycleCount() ;
+                iter[0] = EscapeTimeFloat(fx, fy, fx, fy, limit) ;
+                cycles[0] += GetClockCycleCount() - start ;
+
+                start = GetClockCycleCount() ;
+                iter[1] = EscapeTimeQ28(qx, qy, qx, qy, limit) ;
+                cycles[1] += GetClockCycleCount() - start ;
+
+                start = GetClockCycleCount() ;
+                iter[2] = EscapeTimeDouble(px, py, px, py, limit) ;
+                cycles[2] += GetClockCycleCount() - start ;
+
+                if (iter[0] != iter[2]) diffs[0]++ ;
+                if (iter[1] != iter[2]) diffs[1]++ ;
+                }
+            }
+
+        sprintf(text, "%-7g %5u  %5u  %5u", zooms[z],
+            (unsigned) (cycles[0] / (XSIZE*YSIZE)),
+            (unsigned) (cycles[1] / (XSIZE*YSIZE)),
+            (unsigned) (cycles[2] / (XSIZE*YSIZE))) ;
+        DisplayStringAt(0, row, text) ;
+        row += Font16.Height ;
+        sprintf(text, " diffs  %5u  %5u", diffs[0], diffs[1]) ;
+        DisplayStringAt(0, row, text) ;
+        row += Font16.Height ;
+        }
+
+    DisplayStringAt(0, row + Font16.Height, "cycles/pixel; press button") ;
+    WaitForPushButton() ;
+    }
+
+// Escapes every pixel of the Mandelbrot view and of the first Julia set
+// with each row kernel this CPU supports, and reports the throughput of
+// each and any count that differs from the scalar kernel's.
+static void BenchmarkVector(void)
+    {
+    float (* const zx)[XSIZE] = (float (*)[XSIZE]) SDRAM_SCRATCH ;
+    float (* const zy)[XSIZE] = zx + YSIZE ;
+    float (* const cx)[XSIZE] = zy + YSIZE ;
+    float (* const cy)[XSIZE] = cx + YSIZE ;
+    char text[100] ;
+    int row ;
+
+    ClearDisplay() ;
+    row = Y_MIN ;
+    DisplayStringAt(0, row, "Kernel  Kpixels/s diffs") ;
+    row += 2 * Font16.Height ;
+
+    for (int fractal = 0; fractal < 2; fractal++)
+        {
+        VIEW view ;
+
+        if (fractal == 0) MandelbrotView(&view) ;
+        else JuliaView(&view, 0) ;
+        for (int y = 0; y < YSIZE; y++) ViewOrbits(&view, y, zx[y], zy[y], cx[y], cy[y]) ;
+
+        DisplayStringAt(0, row, fractal == 0 ? "Mandelbrot" : "Julia") ;
+        row += Font16.Height ;
+        for (int k = 0; k < (int) ITEMS(escape_kernels); k++)
+            {
+            const ESCAPE_KERNEL *kernel = &escape_kernels[k] ;
+            uint8_t *iters = (*julia_map)[0] ;
+            uint8_t *scalar = (*mandelbrot_map)[0] ;
+            unsigned diffs = 0 ;
+            uint32_t cycles, start ;
+
+            if (!EscapeKernelSupported(kernel)) continue ;
+
+            start = GetClockCycleCount() ;
+            for (int y = 0; y < YSIZE; y++)
+                {
+                (*kernel->row)(zx[y], zy[y], cx[y], cy[y], view.limit, (k == 0 ? scalar : iters) + y*XSIZE, XSIZE) ;
+                }
+            cycles = GetClockCycleCount() - start ;
+
+            for (int pixel = 0; k > 0 && pixel < XSIZE*YSIZE; pixel++)
+                {
+                if (iters[pixel] != scalar[pixel]) diffs++ ;
+                }
+
+            sprintf(text, " %-6s %9lu %5u", kernel->name,
+                (unsigned long) (XSIZE*YSIZE * (CPU_CLOCK_SPEED_MHZ * 1e3f / cycles)), diffs) ;
+            DisplayStringAt(0, row, text) ;
+            row += Font16.Height ;
+            }
+        }
+
+    DisplayStringAt(0, row + Font16.Height, "press button") ;
+    WaitForPushButton() ;
+    }
+#endif
+
+static BOOL Aborted(void)
+    {
+    if (PushButtonPressed()) aborted = TRUE ;
+    return aborted ;
+    }
+
+static void ChromArtInitialize(void)
+    {
+    uint32_t timeout ;
+
+    *AHB1ENR |= (1 << 23) ; // Turn on DMA2D clock
+    timeout = GetTimeout(1) ;
+    while ((int) (timeout - GetClockCycleCount()) > 0) ;
+
+#ifndef DMA2D_POLLED
+    *NVIC_ISER2 = 1 << (DMA2D_IRQN - 64) ;  // Enable transfer-complete interrupt
+#endif
+
+    // Load color look-up table (CLUT); no hue is ever loaded into entry 255.
+    FG_CLUT[HUE_COLORS] = COLOR_BLACK ;
+    ChromArtWaitForDMA(GfxLoadClut(hue_cycle, HUE_COLORS)) ;
+#ifdef LTDC_L8
+    LtdcInitialize() ;
+#endif
+    }
+
+// Converts the image rows of a frame to the screen: all of them if dirty is
+// NULL, else only the dirty part of each. Rows are grouped into bands of
+// up to DIRTY_BAND_ROWS, each converted across the columns dirty in any of
+// its rows; consecutive bands across the same columns are one transfer.
+static GFX_FENCE __attribute__((unused)) ChromArtXferFrameBuffer(CLR_RGB32 *screen_pixels, FRAME frame_pixels, const DIRTY *dirty)
+    {
+    CLR_RGB32 * const screen = screen_pixels + XPIXELS*DISPLAY_YOFF + DISPLAY_XOFF ;
+    GFX_FENCE fence = gfx_queued ;
+    int top = 0, rows = 0, left = 0, right = 0 ;    // the transfer not yet queued
+
+    if (dirty == NULL)
+        {
+        return GfxConvert(frame_pixels[0], 0, screen, XPIXELS - WIDTH, WIDTH, YSIZE) ;
+        }
+
+    for (int y = 0; y < YSIZE; y++)
+        {
+        int first = y, last = y, bandLeft, bandRight ;
+
+        if (dirty->left[y] >= dirty->right[y]) continue ;
+
+        // A band starts at a dirty row and ends at its last dirty row.
+        bandLeft = dirty->left[y] ;
+        bandRight = dirty->right[y] ;
+        for (y++; y < first + DIRTY_BAND_ROWS && y < YSIZE; y++)
+            {
+            if (dirty->left[y] >= dirty->right[y]) continue ;
+            if (dirty->left[y] < bandLeft) bandLeft = dirty->left[y] ;
+            if (dirty->right[y] > bandRight) bandRight = dirty->right[y] ;
+            last = y ;
+            }
+        y = last ;
+
+        if (rows > 0 && top + rows == first && left == bandLeft && right == bandRight)
+            {
+            rows += last - first + 1 ;
+            continue ;
+            }
+        if (rows > 0)
+            {
+            fence = GfxConvert(&frame_pixels[top][left], WIDTH - (right - left),
+                &screen[top*XPIXELS + left], XPIXELS - (right - left), right - left, rows) ;
+            }
+        top = first ;
+        rows = last - first + 1 ;
+        left = bandLeft ;
+        right = bandRight ;
+        }
+    if (rows > 0)
+        {
+        fence = GfxConvert(&frame_pixels[top][left], WIDTH - (right - left),
+            &screen[top*XPIXELS + left], XPIXELS - (right - left), right - left, rows) ;
+        }
+    return fence ;
+    }
+
+static void ChromArtWaitForDMA(GFX_FENCE fence)
+    {
+    // wait until DMA transfer is finished
+    while (!GfxDone(fence))
+        {
+        // Poll no faster than once every microsecond
+        uint32_t timeout = GetClockCycleCount() + CPU_CLOCK_SPEED_MHZ ;
+        while ((int) (timeout - GetClockCycleCount()) > 0)
+            {
+            if (Aborted()) return ;
+            }
+        }
+    }
+
+// Graphics command queue: DMA2D operations are queued in a ring and run
+// one after another, each started from the transfer-complete interrupt of
+// the one before. Every command gets a fence (its sequence number), which
+// is done once the command and everything queued before it has finished.
+static GFX_FENCE GfxSubmit(const GFX_COMMAND *cmd)
+    {
+    GFX_FENCE fence ;
+
+    while (gfx_queued - gfx_completed >= GFX_QUEUE_SIZE) GfxService() ;
+
+    DISABLE_INTERRUPTS() ;
+    gfx_queue[gfx_queued % GFX_QUEUE_SIZE] = *cmd ;
+    fence = ++gfx_queued ;
+    if (fence - gfx_completed == 1) GfxStart() ;
+    ENABLE_INTERRUPTS() ;
+
+    return fence ;
+    }
+
+// Loads the oldest queued command into the DMA2D and starts it.
+static void GfxStart(void)
+    {
+    const GFX_COMMAND *cmd = &gfx_queue[gfx_completed % GFX_QUEUE_SIZE] ;
+
+    if (cmd->mode == GFX_CLUT_LOAD)
+        {
+        DMA2D->CR       = DMA2D_CR_CTCIE ;
+        DMA2D->FGCMAR   = cmd->fgcmar ;
+        DMA2D->FGPFCCR  = cmd->fgpfccr ;
+        return ;
+        }
+
+    DMA2D->FGMAR    = cmd->fgmar ;
+    DMA2D->FGOR     = cmd->fgor ;
+    DMA2D->FGPFCCR  = cmd->fgpfccr ;
+    DMA2D->FGCOLR   = cmd->fgcolr ;
+    DMA2D->BGMAR    = cmd->bgmar ;
+    DMA2D->BGOR     = cmd->bgor ;
+    DMA2D->BGPFCCR  = cmd->bgpfccr ;
+    DMA2D->OMAR     = cmd->omar ;
+    DMA2D->OOR      = cmd->oor ;
+    DMA2D->OPFCCR   = cmd->opfccr ;
+    DMA2D->OCOLR    = cmd->ocolr ;
+    DMA2D->NLR      = cmd->nlr ;
+    DMA2D->CR       = cmd->mode | DMA2D_CR_TCIE | DMA2D_CR_START ;
+    }
+
+// Retires the running command and starts the next one, if any.
+static void GfxComplete(void)
+    {
+    if (++gfx_completed != gfx_queued) GfxStart() ;
+    }
+
+// With DMA2D_POLLED there is no interrupt, so the queue is advanced by
+// whoever is waiting on it.
+static void GfxService(void)
+    {
+#ifdef DMA2D_POLLED
+    if (gfx_completed != gfx_queued && (DMA2D->CR & DMA2D_CR_START) == 0
+        && (DMA2D->FGPFCCR & DMA2D_PFCCR_START) == 0) GfxComplete() ;
+#endif
+    }
+
+static BOOL GfxDone(GFX_FENCE fence)
+    {
+    GfxService() ;
+    return (int32_t) (gfx_completed - fence) >= 0 ;
+    }
+
+// DMA2D transfer-complete (or CLUT-transfer-complete) interrupt.
+void DMA2D_IRQHandler(void)
+    {
+    DMA2D->IFCR = DMA2D_IFCR_CTCIF | DMA2D_IFCR_CCTCIF ;
+    GfxComplete() ;
+    }
+
+// Automatic CLUT load: the DMA2D copies entries ARGB8888 colors from
+// palette into FG_CLUT, which the CPU must not touch meanwhile. Queued like
+// any transfer, it cannot change the colors of a conversion under way.
+static GFX_FENCE GfxLoadClut(const CLR_RGB32 *palette, int entries)
+    {
+    GFX_COMMAND cmd = {0} ;
+
+    cmd.mode    = GFX_CLUT_LOAD ;
+    cmd.fgcmar  = (uint32_t) palette ;
+    cmd.fgpfccr = DMA2D_PFCCR_CS(entries) | DMA2D_PFCCR_START | DMA2D_CM_L8 ;
+    return GfxSubmit(&cmd) ;
+    }
+
+// Register-to-memory: fills a rectangle of 32-bit words with one value.
+static GFX_FENCE GfxFill(uint32_t *dst, int dstSkip, int width, int height, uint32_t value)
+    {
+    GFX_COMMAND cmd = {0} ;
+
+    cmd.mode    = DMA2D_MODE_R2M ;
+    cmd.omar    = (uint32_t) dst ;
+    cmd.oor     = dstSkip ;
+    cmd.opfccr  = DMA2D_CM_ARGB8888 ;
+    cmd.ocolr   = value ;
+    cmd.nlr     = (width << 16) | height ;
+    return GfxSubmit(&cmd) ;
+    }
+
+// Clears an L8 frame (image rows only) to one color index. The DMA2D has
+// no 8-bit output format, so each ARGB8888 "pixel" is four L8 pixels.
+static GFX_FENCE GfxFillFrame(FRAME frame_pixels, CLR_INDEX color)
+    {
+    return GfxFill((uint32_t *) frame_pixels[0], 0, WIDTH/4, YSIZE, color * 0x01010101u) ;
+    }
+
+// Memory-to-memory: copies a rectangle of L8 pixels.
+static GFX_FENCE __attribute__((unused)) GfxCopy(const CLR_INDEX *src, int srcSkip, CLR_INDEX *dst, int dstSkip, int width, int height)
+    {
+    GFX_COMMAND cmd = {0} ;
+
+    cmd.mode    = DMA2D_MODE_M2M ;
+    cmd.fgmar   = (uint32_t) src ;
+    cmd.fgor    = srcSkip ;
+    cmd.fgpfccr = DMA2D_CM_L8 ;
+    cmd.omar    = (uint32_t) dst ;
+    cmd.oor     = dstSkip ;
+    cmd.nlr     = (width << 16) | height ;
+    return GfxSubmit(&cmd) ;
+    }
+
+// Memory-to-memory with pixel format conversion: L8 through FG_CLUT to
+// ARGB8888.
+static GFX_FENCE GfxConvert(const CLR_INDEX *src, int srcSkip, CLR_RGB32 *dst, int dstSkip, int width, int height)
+    {
+    GFX_COMMAND cmd = {0} ;
+
+    cmd.mode    = DMA2D_MODE_M2M_PFC ;
+    cmd.fgmar   = (uint32_t) src ;
+    cmd.fgor    = srcSkip ;
+    cmd.fgpfccr = DMA2D_CM_L8 ;
+    cmd.omar    = (uint32_t) dst ;
+    cmd.oor     = dstSkip ;
+    cmd.opfccr  = DMA2D_CM_ARGB8888 ;
+    cmd.nlr     = (width << 16) | height ;
+    return GfxSubmit(&cmd) ;
+    }
+
+// Memory-to-memory with blending: draws one color through an A8 coverage
+// mask onto an ARGB8888 rectangle.
+static GFX_FENCE GfxBlend(const uint8_t *mask, int maskSkip, CLR_RGB32 color, CLR_RGB32 *dst, int dstSkip, int width, int height)
+    {
+    GFX_COMMAND cmd = {0} ;
+
+    cmd.mode    = DMA2D_MODE_M2M_BLEND ;
+    cmd.fgmar   = (uint32_t) mask ;
+    cmd.fgor    = maskSkip ;
+    cmd.fgpfccr = DMA2D_CM_A8 ;
+    cmd.fgcolr  = color & 0x00FFFFFF ;
+    cmd.bgmar   = (uint32_t) dst ;
+    cmd.bgor    = dstSkip ;
+    cmd.bgpfccr = DMA2D_CM_ARGB8888 ;
+    cmd.omar    = (uint32_t) dst ;
+    cmd.oor     = dstSkip ;
+    cmd.opfccr  = DMA2D_CM_ARGB8888 ;
+    cmd.nlr     = (width << 16) | height ;
+    return GfxSubmit(&cmd) ;
+    }
+
+#ifdef LTDC_L8
+// LTDC presentation: layer 2 is an L8 window over the image area that
+// scans the frame buffer out directly through its own CLUT, so frames need
+// no DMA2D conversion and palette animation is a CLUT reload. Layer 1 (the
+// ARGB8888 screen the library draws on) still shows the header, title and
+// footer around it.
+static void LtdcInitialize(void)
+    {
+    uint32_t hbp = (LTDC->BPCR >> 16) & 0xFFF ;    // accumulated horizontal back porch
+    uint32_t vbp = LTDC->BPCR & 0x7FF ;            // accumulated vertical back porch
+    uint32_t xlft = hbp + 1 + DISPLAY_XOFF ;
+    uint32_t ytop = vbp + 1 + DISPLAY_YOFF ;
+
+    LTDC->L2.WHPCR  = ((xlft + WIDTH - 1) << 16) | xlft ;
+    LTDC->L2.WVPCR  = ((ytop + YSIZE - 1) << 16) | ytop ;
+    LTDC->L2.PFCR   = LTDC_PF_L8 ;
+    LTDC->L2.CACR   = 255 ;                         // opaque
+    LTDC->L2.BFCR   = (4 << 8) | 5 ;                // constant alpha blending
+    LTDC->L2.CFBAR  = (uint32_t) frames[1] ;
+    LTDC->L2.CFBLR  = (WIDTH << 16) | (WIDTH + 3) ; // pitch, line length + 3
+    LTDC->L2.CFBLNR = YSIZE ;
+    LtdcLoadClut(0) ;
+    LTDC->L2.CR     = LTDC_LxCR_CLUTEN | LTDC_LxCR_LEN ;
+    LTDC->SRCR      = LTDC_SRCR_IMR ;
+    }
+
+// Switches scanout to a frame at the next vertical blanking and waits until
+// it has happened, after which the previous frame may be drawn into again.
+static void LtdcShowFrame(FRAME frame_pixels)
+    {
+    LTDC->L2.CFBAR  = (uint32_t) frame_pixels ;
+    LTDC->SRCR      = LTDC_SRCR_VBR ;
+#ifdef LTDC_EMULATED
+    LTDC->SRCR      = 0 ;   // the emulated panel reloads at once
+#endif
+    while ((LTDC->SRCR & LTDC_SRCR_VBR) != 0)
+        {
+        if (Aborted()) return ;
+        }
+    }
+
+// Loads the layer CLUT with the DMA2D palette rotated by offset (the same
+// color cycling the Mandelbrot set gets by remapping with clroff). The CLUT
+// is only written during vertical blanking.
+static void LtdcLoadClut(CLR_INDEX offset)
+    {
+#ifndef LTDC_EMULATED
+    while ((LTDC->CDSR & LTDC_CDSR_VSYNCS) == 0) ;
+#endif
+    for (int color = 0; color < HUE_COLORS; color++)
+        {
+        LtdcWriteClut(color, hue_cycle[offset % HUE_COLORS + color]) ;
+        }
+    LtdcWriteClut(255, COLOR_BLACK) ;
+    }
+
+static void LtdcWriteClut(int color, CLR_RGB32 rgb)
+    {
+    LTDC->L2.CLUTWR = (color << 24) | (rgb & 0x00FFFFFF) ;
+#ifdef LTDC_EMULATED
+    ltdc_clut[color] = rgb | 0xFF000000 ;
+#endif
+    }
+#endif
+
+#ifdef LTDC_EMULATED
+// What the emulated panel shows in the layer 2 window, as ARGB8888.
+static void __attribute__((unused)) LtdcScanout(CLR_RGB32 *dst)
+    {
+    const CLR_INDEX *src = (const CLR_INDEX *) LTDC->L2.CFBAR ;
+    int pitch = LTDC->L2.CFBLR >> 16 ;
+    int width = (LTDC->L2.CFBLR & 0x1FFF) - 3 ;
+
+    for (uint32_t y = 0; y < LTDC->L2.CFBLNR; y++)
+        {
+        for (int x = 0; x < width; x++) *dst++ = ltdc_clut[src[y*pitch + x]] ;
+        }
+    }
+#endif
+
+static void PutChar(CLR_INDEX (*pixels)[WIDTH], int x, int y, char ch, sFONT *font)
+    {
+    const GLYPH *glyph = CachedGlyph(ch, font) ;
+
+    for (int row = 0; row < font->Height; row++)
+        {
+        BlitRow(&pixels[y + row][x], glyph->rows[row], font->Width, textColor) ;
+        }
+    }
+
+// The glyph of a character, read from the font table with BitmapAddress
+// and GetBitmapRow only the first time it is drawn (or after another glyph
+// has taken its cache entry).
+static const GLYPH *CachedGlyph(char ch, sFONT *font)
+    {
+    GLYPH *glyph = &glyph_cache[(unsigned) (ch + font->Height) % GLYPH_CACHE_SIZE] ;
+
+    if (glyph->font != font || glyph->ch != ch)
+        {
+        uint8_t *pline = BitmapAddress(ch, (uint8_t *) font->table, font->Height, font->Width) ;
+        uint32_t mask = ~0u << (32 - font->Width) ;
+
+        for (int row = 0; row < font->Height; row++)
+            {
+            glyph->rows[row] = GetBitmapRow(pline) & mask ;
+            pline += (font->Width + 7) / 8 ;
+            }
+        glyph->font = font ;
+        glyph->ch = ch ;
+        }
+    return glyph ;
+    }
+
+// Sets the pixels of a glyph row from dst on, four at a time: each nibble
+// of bits (from the top) selects which of four bytes to replace. The four
+// go through memcpy, which compiles to one (unaligned) word load and store;
+// the last width % 4 pixels are set one by one, so that no byte past the
+// glyph is touched.
+static void BlitRow(CLR_INDEX *dst, uint32_t bits, int width, CLR_INDEX color)
+    {
+    static const uint32_t bytes[16] =   // nibble to byte mask, leftmost pixel lowest
+        {
+        0x00000000, 0xFF000000, 0x00FF0000, 0xFFFF0000,
+        0x0000FF00, 0xFF00FF00, 0x00FFFF00, 0xFFFFFF00,
+        0x000000FF, 0xFF0000FF, 0x00FF00FF, 0xFFFF00FF,
+        0x0000FFFF, 0xFF00FFFF, 0x00FFFFFF, 0xFFFFFFFF
+        } ;
+    uint32_t colors = color * 0x01010101u ;
+    int x ;
+
+    for (x = 0; x + 4 <= width && bits != 0; x += 4, bits <<= 4)
+        {
+        uint32_t mask = bytes[bits >> 28] ;
+        uint32_t word ;
+
+        if (mask == 0) continue ;
+        memcpy(&word, dst + x, sizeof(word)) ;
+        word = (word & ~mask) | (colors & mask) ;
+        memcpy(dst + x, &word, sizeof(word)) ;
+        }
+    for (; x < width && bits != 0; x++, bits <<= 1)
+        {
+        if ((int32_t) bits < 0) dst[x] = color ;
+        }
+    }
+
+#ifdef BENCHMARK
+// PutChar as it was before the glyph cache: both assembly functions on
+// every row, and a branch per pixel.
+static void PutCharBitwise(CLR_INDEX (*pixels)[WIDTH], int x, int y, char ch, sFONT *font)
+    {
+    uint8_t *pline = BitmapAddress(ch, (uint8_t *) font->table, font->Height, font->Width) ;
+    for (int row = 0; row < font->Height; row++)
+        {
+        uint32_t bits = GetBitmapRow(pline) ;
+        for (int col = 0; col < font->Width; col++)
+            {
+            if ((int32_t) bits < 0) pixels[y + row][x + col] = textColor ;
+            bits <<= 1 ;
+            }
+        pline += (font->Width + 7) / 8 ;
+        }
+    }
+#endif
+
+static void PutString(CLR_INDEX (*pixels)[WIDTH], int x, int y, char *str, sFONT *font)
+    {
+    while (*str != '\0')
+        {
+        PutChar(pixels, x, y, *str++, font) ;
+        x += font->Width ;
+        }
+    }
+
+static void TextColor(CLR_INDEX color)
+    {
+    textColor = color ;
+    }
+
+// Clears both frame buffers and the title area of the screen, and draws
+// the title, for fractals that redraw only the image area on every frame.
+static void FractalBackground(char *title)
+    {
+    GFX_FENCE fence ;
+
+#ifndef LTDC_L8
+    GfxLoadClut(hue_cycle, HUE_COLORS) ;  // the Mandelbrot set leaves it rotated
+#endif
+    GfxFillFrame(frames[0], INDEX_RED) ;
+    fence = GfxFillFrame(frames[1], INDEX_RED) ;
+    FractalTitle(title) ;
+#ifdef LTDC_L8
+    LtdcLoadClut(0) ;
+    back_frame = (LTDC->L2.CFBAR == (uint32_t) frames[0]) ? 1 : 0 ;
+#else
+    back_frame = 0 ;
+#endif
+    frame_pixels = frames[back_frame] ;
+    DirtyAll(&screen_dirty) ;   // still the last fractal
+    ChromArtWaitForDMA(fence) ;
+    }
+
+// Starts converting the frame just drawn and switches drawing to the other
+// buffer, once its own conversion has finished. The DMA2D converts this
+// frame while the CPU renders the next one. With LTDC_L8 the frame is
+// instead scanned out as it is, from the next vertical blanking on.
+static void PresentFrame(void)
+    {
+    PresentChanges(NULL) ;
+    }
+
+// PresentFrame for a frame that was filled with one color (the same as the
+// frame before) and then drawn on only where drawn says: the DMA2D converts
+// just those rows and the ones the frame before had drawn on, since the
+// rest of the screen already shows the fill color.
+static void PresentChanges(const DIRTY *drawn)
+    {
+#ifdef LTDC_L8
+    (void) drawn ;
+    LtdcShowFrame(frame_pixels) ;
+    back_frame = 1 - back_frame ;
+    frame_pixels = frames[back_frame] ;
+#else
+    static DIRTY changed ;
+
+    if (drawn != NULL)
+        {
+        changed = *drawn ;
+        DirtyMerge(&changed, &screen_dirty) ;
+        screen_dirty = *drawn ;
+        }
+    else DirtyAll(&screen_dirty) ;
+    frame_fence[back_frame] = ChromArtXferFrameBuffer(screen_pixels, frame_pixels, drawn != NULL ? &changed : NULL) ;
+    back_frame = 1 - back_frame ;
+    frame_pixels = frames[back_frame] ;
+    ChromArtWaitForDMA(frame_fence[back_frame]) ;
+#endif
+    }
+
+static void DirtyClear(DIRTY *dirty)
+    {
+    for (int y = 0; y < HEIGHT; y++)
+        {
+        dirty->left[y] = WIDTH ;
+        dirty->right[y] = 0 ;
+        }
+    }
+
+static void DirtyAll(DIRTY *dirty)
+    {
+    for (int y = 0; y < HEIGHT; y++)
+        {
+        dirty->left[y] = 0 ;
+        dirty->right[y] = WIDTH ;
+        }
+    }
+
+// Adds pixel (x, y) of the frame to the dirty part of its row. The frame
+// is addressed as WritePixel does it, so (WIDTH, y) is (0, y + 1).
+static void DirtyMark(DIRTY *dirty, int x, int y)
+    {
+    if (x >= WIDTH)
+        {
+        y += x / WIDTH ;
+        x %= WIDTH ;
+        }
+    if (x < dirty->left[y]) dirty->left[y] = x ;
+    if (x >= dirty->right[y]) dirty->right[y] = x + 1 ;
+    }
+
+static void __attribute__((unused)) DirtyMerge(DIRTY *dirty, const DIRTY *more)
+    {
+    for (int y = 0; y < HEIGHT; y++)
+        {
+        if (more->left[y] < dirty->left[y]) dirty->left[y] = more->left[y] ;
+        if (more->right[y] > dirty->right[y]) dirty->right[y] = more->right[y] ;
+        }
+    }
+
+// The title is below the image and never changes, so it is drawn once into
+// an A8 mask and blended onto the screen by the DMA2D; the frames no longer
+// carry it and only their image rows are ever converted.
+static void FractalTitle(char *title)
+    {
+    CLR_RGB32 * const screen = screen_pixels + XPIXELS*(DISPLAY_YOFF + YSIZE) + DISPLAY_XOFF ;
+    int width, xpos ;
+    sFONT * const font = &Font16 ;
+
+    memset(title_mask, 0, sizeof(title_mask)) ;
+    TextColor(0xFF) ;   // full coverage
+    width = strlen(title) * font->Width ;
+    xpos = (XSIZE - width) / 2 ;
+    PutString(title_mask, xpos, TITLE_ROWS - font->Height, title, font) ;
+
+    GfxFill(screen, XPIXELS - WIDTH, WIDTH, TITLE_ROWS, hue_cycle[INDEX_RED]) ;
+    GfxBlend(title_mask[0], 0, hue_cycle[INDEX_YLW], screen, XPIXELS - WIDTH, WIDTH, TITLE_ROWS) ;
     }
 
 static int SanityChecksOK(void)
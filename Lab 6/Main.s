@@ -65,6 +65,9 @@ int __attribute__((weak)) Count(int cells[], int numb, int value)
 
 #define CPU_CLOCK_SPEED_MHZ 168
 
+#define UNDO_MOVES  2           // made and not yet taken back: ComputerMove looks two ahead
+#define UNDO_SIZE   (UNDO_MOVES*(BOARD_ROWS*BOARD_COLS + 2))
+
 typedef enum {FALSE = 0, TRUE = 1} BOOL ;
 
 static int colors[] = {BOARD_COLOR, COLOR_WHITE, COLOR_RED, COLOR_GREEN} ;
@@ -72,6 +75,44 @@ static int colors[] = {BOARD_COLOR, COLOR_WHITE, COLOR_RED, COLOR_GREEN} ;
 #define VALID       1
 #define COMPUTER    2
 #define HUMAN       3
+#define SIDE(who)   ((who) - COMPUTER)  // count[] and discs[] index of COMPUTER or HUMAN
+
+// Build with -DSEARCH to have the computer choose its moves by an
+// alpha-beta search, deepened for as long as SEARCH_MSEC allows.
+#ifdef SEARCH
+#define BITBOARD
+#ifndef SEARCH_MSEC
+#define SEARCH_MSEC 1000        // per move
+#endif
+#define SCORE_INFINITE  32767   // fits a TABLE_ENTRY's score
+#define SCORE_DISC      500     // per disc of a won or lost game; above any evaluation
+#define TABLE_BUCKETS   512     // of two 8-byte entries: 8 KB of SRAM
+#define PASS            -1      // PlayMove's cell for passing
+#define TT_EXACT        0       // a TABLE_ENTRY's score is the position's ...
+#define TT_LOWER        1       // ... or at least that ...
+#define TT_UPPER        2       // ... or at most that
+#endif
+
+// Build with -DBITBOARD to keep the discs as two 64-bit masks as well and
+// find and make moves with shifts and masks, all eight directions at once.
+// cells[] then just mirrors the masks for display.
+#ifdef BITBOARD
+#if BOARD_ROWS != 8 || BOARD_COLS != 8
+#error "BITBOARD needs an 8x8 board"
+#endif
+typedef uint64_t    BITS ;          // bit n is cells[n]
+#define CELL_BIT(n) ((BITS) 1 << (n))
+#define NOT_COL_0   0xFEFEFEFEFEFEFEFEull
+#define NOT_COL_7   0x7F7F7F7F7F7F7F7Full
+#define DISCS(bits) __builtin_popcountll(bits)
+#endif
+
+#ifdef SEARCH
+#define CORNERS     0x8100000000000081ull
+#define X_SQUARES   0x0042000000004200ull   // diagonally next to a corner
+#define C_SQUARES   0x4281000000008142ull   // on an edge next to a corner
+#define EDGES       0x3C0081818181003Cull   // the rest of the edges
+#endif
 
 typedef struct
     {
@@ -81,9 +122,71 @@ typedef struct
     int             ypos ;
     int             cell_size ;
     int             line_width ;
-    int             cells[0] ;
+#ifdef BITBOARD
+    BITS            discs[2] ;      // the computer's and the human's
+#endif
+    int             count[2] ;      // discs of the computer and of the human
+    int             empties ;       // cells in empty[]
+    int *           empty ;         // the cells without a disc, in no order
+    int *           slot ;          // where each of those is in empty[]
+    int *           neighbors ;     // discs around each cell: the frontier is the empty cells with any
+    int             cells[0] ;      // followed by empty[], slot[] and neighbors[]
     } BOARD ;
 
+// The moves made this turn, for UnmakeMove to take back: the cells that
+// each move flipped, then how many there were, then the cell moved to.
+// A build with -DSEARCH takes nothing back, so MakeMove leaves it empty.
+typedef struct
+    {
+    int             top ;
+    uint8_t         cells[UNDO_SIZE] ;
+    } UNDO_STACK ;
+
+#ifdef BITBOARD
+// A step in one direction: a left shift (right if negative) of the cell
+// bits, and the cells that a step can reach without leaving the row.
+typedef struct
+    {
+    int             shift ;
+    BITS            mask ;
+    } DIRECTION ;
+#endif
+
+#ifdef SEARCH
+// A position in the search, from the point of view of the side to move.
+// hash is its Zobrist key: the XOR of zobrist[side][cell] for every disc,
+// and of zobrist_turn as well when the human is to move.
+typedef struct
+    {
+    BITS            own, opp ;      // the discs of the side to move and of the other
+    int             side ;          // SIDE() of the side to move
+    uint64_t        hash ;
+    } POSITION ;
+
+// A transposition table entry. The hash's low bits pick the bucket and its
+// upper half is kept to tell the positions that share one apart.
+typedef struct
+    {
+    uint32_t        lock ;          // upper half of the hash
+    int16_t         score ;
+    uint8_t         depth : 6 ;     // of the search that gave the score; 0 if unused
+    uint8_t         bound : 2 ;     // TT_EXACT, TT_LOWER or TT_UPPER
+    uint8_t         move  : 6 ;     // the best move found, or the one that cut off
+    uint8_t         age   : 2 ;     // of search.age when stored
+    } TABLE_ENTRY ;
+
+typedef struct
+    {
+    uint32_t        deadline ;      // GetClockCycleCount at which to give up
+    BOOL            stopped ;       // the deadline passed during this iteration
+    int             depth ;         // of the last iteration completed
+    uint32_t        nodes ;
+    uint32_t        hits ;          // table probes that found the position
+    uint32_t        misses ;        // and that did not
+    unsigned        age ;           // SearchMove calls so far
+    } SEARCH_STATE ;
+#endif
+
 typedef struct
     {
     const uint8_t * table ;
@@ -98,8 +201,19 @@ extern sFONT        Font20 ;
 extern sFONT        Font24 ;
 
 // Functions private to the main program
+static void         AddNeighbors(BOARD *board, int cell, int delta) ;
+#ifndef SEARCH
 static int          BestHumanMove(BOARD *board) ;
+#endif
+#ifdef BITBOARD
+static BITS         BitFlips(BITS own, BITS opp, int cell) ;
+static BITS         BitMoves(BITS own, BITS opp) ;
+static void         BitsToCells(BOARD *board, BITS valid) ;
+#endif
 static int          Cells(BOARD *board) ;
+#ifdef BITBOARD
+static BITS         CellsToBits(BOARD *board, int who) ;
+#endif
 static void         ComputerMove(BOARD *board) ;
 static BOARD *      CreateBoard(int rows, int cols, int xpos, int ypos, int cell_size, int line_width) ;
 static void         DisplayBoard(BOARD *board) ;
@@ -108,11 +222,66 @@ static void         Display1Score(BOARD *board, char *label, int who, int xpos,
 static void         DisplayScores(BOARD *board) ;
 static void         DrawGrid(BOARD *board) ;
 static void         DrawPiece(BOARD *board, int row, int col, int who) ;
+#ifdef SEARCH
+static int          Evaluate(BITS own, BITS opp, BITS moves) ;
+#endif
 static BOOL         FindMoves(BOARD *board, int player) ;
+#ifdef SEARCH
+static uint64_t     HashPosition(const POSITION *pos) ;
+#endif
 static void         HumanMove(BOARD *board) ;
+#ifdef SEARCH
+static void         InitializeSearch(void) ;
+#endif
 static void         InitializeTouchScreen(void) ;
+#ifndef SEARCH
+static int          ListMoves(BOARD *board, int moves[]) ;
+#endif
 static void         MakeMove(BOARD *board, int cell, int player) ;
+#ifdef SEARCH
+static int          Negamax(const POSITION *pos, int depth, int alpha, int beta) ;
+#endif
+#ifdef BITBOARD
+static BITS         Occluded(BITS gen, BITS pro, const DIRECTION *dir) ;
+#endif
+static void         Occupy(BOARD *board, int cell, int who) ;
+#ifdef SEARCH
+static int          OrderMoves(BITS moves, int first, uint8_t order[]) ;
+static void         PlayMove(const POSITION *pos, int cell, POSITION *next) ;
+static TABLE_ENTRY *ProbeTable(uint64_t hash) ;
+static int          SearchMove(BOARD *board, int player) ;
+#endif
 static void         SetFontSize(sFONT *font) ;
+#ifdef BITBOARD
+static BITS         Shift(BITS bits, int shift) ;
+static BITS         Step(BITS bits, const DIRECTION *dir) ;
+#endif
+#ifdef SEARCH
+static void         StoreTable(uint64_t hash, int depth, int bound, int score, int move) ;
+#endif
+#ifndef SEARCH
+static void         UnmakeMove(BOARD *board) ;
+static void         Vacate(BOARD *board, int cell) ;
+#endif
+
+#ifdef BITBOARD
+static const DIRECTION directions[] =
+    {
+    {+1, NOT_COL_0}, {-1, NOT_COL_7}, {+8, ~0ull}, {-8, ~0ull},
+    {+9, NOT_COL_0}, {+7, NOT_COL_7}, {-7, NOT_COL_0}, {-9, NOT_COL_7}
+    } ;
+#endif
+#ifdef SEARCH
+static const BITS   move_order[] =  // moves are tried group by group
+    {
+    CORNERS, ~(CORNERS | X_SQUARES | C_SQUARES), C_SQUARES, X_SQUARES
+    } ;
+static SEARCH_STATE search ;
+static TABLE_ENTRY  table[TABLE_BUCKETS][2] ;
+static uint64_t     zobrist[2][64] ;
+static uint64_t     zobrist_turn ;
+#endif
+static UNDO_STACK   undo ;
 
 int main()
     {
@@ -122,10 +291,14 @@ int main()
     InitializeHardware(HEADER, "Lab 6E: Reversi") ;
     InitializeTouchScreen() ;
     board = CreateBoard(BOARD_ROWS, BOARD_COLS, BOARD_XPOS, BOARD_YPOS, CELL_SIZE, LINE_WIDTH) ;
+#ifdef SEARCH
+    InitializeSearch() ;
+#endif
 
     player = HUMAN ;
     for (;;)
         {
+        undo.top = 0 ;  // the moves so far are for good
         DisplayScores(board) ;
 
         if (player == HUMAN)
@@ -162,9 +335,9 @@ int main()
 
 BOARD *CreateBoard(int rows, int cols, int xpos, int ypos, int cell_size, int line_width)
     {
-    int row, col ;
+    int row, col, cell ;
 
-    BOARD *board = (BOARD *) malloc(sizeof(BOARD) + rows*cols*sizeof(int)) ;
+    BOARD *board = (BOARD *) malloc(sizeof(BOARD) + 4*rows*cols*sizeof(int)) ;
     
     board->rows = rows ;
     board->cols = cols ;
@@ -174,11 +347,28 @@ BOARD *CreateBoard(int rows, int cols, int xpos, int ypos, int cell_size, int li
     board->line_width = line_width ;
     memset(board->cells, EMPTY, rows*cols*sizeof(int)) ;
 
+    board->empty     = board->cells + rows*cols ;
+    board->slot      = board->empty + rows*cols ;
+    board->neighbors = board->slot  + rows*cols ;
+    board->count[SIDE(COMPUTER)] = 0 ;
+    board->count[SIDE(HUMAN)]    = 0 ;
+    board->empties = rows*cols ;
+    for (cell = 0; cell < rows*cols; cell++)
+        {
+        board->empty[cell] = cell ;
+        board->slot[cell] = cell ;
+        board->neighbors[cell] = 0 ;
+        }
+
     row = rows/2 ;  col = cols/2 ;
-    board->cells[cols*(row-1) + col - 1] = COMPUTER ;
-    board->cells[cols*(row  ) + col    ] = COMPUTER ;
-    board->cells[cols*(row-1) + col    ] = HUMAN ;
-    board->cells[cols*(row  ) + col - 1] = HUMAN ;
+    Occupy(board, cols*(row-1) + col - 1, COMPUTER) ;
+    Occupy(board, cols*(row  ) + col    , COMPUTER) ;
+    Occupy(board, cols*(row-1) + col    , HUMAN) ;
+    Occupy(board, cols*(row  ) + col - 1, HUMAN) ;
+#ifdef BITBOARD
+    board->discs[SIDE(COMPUTER)] = CellsToBits(board, COMPUTER) ;
+    board->discs[SIDE(HUMAN)]    = CellsToBits(board, HUMAN) ;
+#endif
 
     DrawGrid(board) ;
     return board ;
@@ -240,7 +430,7 @@ static void Display1Score(BOARD *board, char *label, int who, int xpos, int mpie
     int radius, center_x, center_y ;
     char text[100] ;
 
-    sprintf(text, "%s :%u", label, Count(board->cells, Cells(board), who)) ;
+    sprintf(text, "%s :%u", label, board->count[SIDE(who)]) ;
     xpos += FONT_SCORE.Width * mpier * strlen(text) ;
     
     radius = FONT_SCORE.Height/2 - 2 ;
@@ -260,86 +450,98 @@ static void Display1Score(BOARD *board, char *label, int who, int xpos, int mpie
 
 static void ComputerMove(BOARD *board)
     {
-    int cell, cells, best, worst, bytes ;
-    BOARD *temp ;
-
-    cells = Cells(board) ;
-    bytes = sizeof(BOARD) + cells * sizeof(int) ;
-    temp = (BOARD *) malloc(bytes) ;
-
+#ifdef SEARCH
+    MakeMove(board, SearchMove(board, COMPUTER), COMPUTER) ;
+#else
+    int moves[BOARD_ROWS*BOARD_COLS] ;
+    int count, best, worst ;
+
+    // Each move is tried on the board itself and then taken back. The
+    // human's replies are marked over the computer's moves, so those are
+    // listed first.
+    count = ListMoves(board, moves) ;
     best = 0 ;
-    worst = cells ;
-    for (cell = 0; cell < cells; cell++)
+    worst = Cells(board) ;
+    for (int i = 0; i < count; i++)
         {
         int score ;
 
-        if (board->cells[cell] != VALID) continue ;
- 
-        memcpy(temp, board, bytes) ;
-        temp->cells[cell] = COMPUTER ;
-        FindMoves(temp, HUMAN) ;
-        score = BestHumanMove(temp) ;
+        MakeMove(board, moves[i], COMPUTER) ;
+        FindMoves(board, HUMAN) ;
+        score = BestHumanMove(board) ;
+        UnmakeMove(board) ;
         if (score < worst)
             {
             worst = score ;
-            best = cell ;
+            best = moves[i] ;
             }
         }
-    free(temp) ;
 
     MakeMove(board, best, COMPUTER) ;
+#endif
     }
 
+#ifndef SEARCH
 static int BestHumanMove(BOARD *board)
     {
-    int cell, cells, best, bytes ;
-    BOARD *temp ;
-
-    cells = Cells(board) ;
-    bytes = sizeof(BOARD) + cells * sizeof(int) ;
-    temp = (BOARD *) malloc(bytes) ;
+    int moves[BOARD_ROWS*BOARD_COLS] ;
+    int count, best ;
 
+    count = ListMoves(board, moves) ;
     best = 0 ;
-    for (cell = 0; cell < cells; cell++)
+    for (int i = 0; i < count; i++)
         {
         int score ;
 
-        if (board->cells[cell] != VALID) continue ;
-
-        memcpy(temp, board, bytes) ;
-        temp->cells[cell] = HUMAN ;
-        score = Count(board->cells, Cells(board), HUMAN) - Count(board->cells, Cells(board), COMPUTER) ;
+        MakeMove(board, moves[i], HUMAN) ;
+        score = board->count[SIDE(HUMAN)] - board->count[SIDE(COMPUTER)] ;
+        UnmakeMove(board) ;
         if (score > best) best = score ;
         }
-    free(temp) ;
 
     return best ;
     }
 
+// Copies the cells marked VALID to moves[] and returns how many.
+static int ListMoves(BOARD *board, int moves[])
+    {
+    int count = 0 ;
+
+    for (int cell = 0; cell < Cells(board); cell++)
+        {
+        if (board->cells[cell] == VALID) moves[count++] = cell ;
+        }
+
+    return count ;
+    }
+#endif
+
 static BOOL FindMoves(BOARD *board, int player)
     {
+#ifdef BITBOARD
+    BITS valid = BitMoves(board->discs[SIDE(player)], board->discs[1 - SIDE(player)]) ;
+
+    BitsToCells(board, valid) ;
+    return valid != 0 ;
+#else
     int opponent, *pcell ;
-    int cell, cells ;
+    int cell, i ;
     BOOL hasMoves ;
 
     hasMoves = FALSE ;
-    cells = Cells(board) ;
 
-    // Reset any left-over "VALID" cells to "EMPTY"
-    pcell = board->cells ;
-    for (cell = 0; cell < cells; cell++, pcell++)
-        {
-        if (*pcell == VALID) *pcell = EMPTY ;
-        }
-
-    // Mark all valid moves
+    // Reset any left-over "VALID" cells to "EMPTY" and mark all valid
+    // moves. Only a cell on the frontier can be one. A cell marked earlier
+    // in the loop stops a line just as an empty one does.
     opponent = (player == HUMAN) ? COMPUTER : HUMAN ;
-    pcell = board->cells ;
-    for (cell = 0; cell < cells; cell++, pcell++)
+    for (i = 0; i < board->empties; i++)
         {
         int row, col, drow ;
 
-        if (*pcell != EMPTY) continue ;
+        cell = board->empty[i] ;
+        pcell = &board->cells[cell] ;
+        *pcell = EMPTY ;
+        if (board->neighbors[cell] == 0) continue ;
 
         row = cell / board->cols ;
         col = cell % board->cols ;  
@@ -365,7 +567,7 @@ static BOOL FindMoves(BOARD *board, int player)
                     if (!Between(0, c += dcol, board->cols - 1)) break ;
 
                     cell = board->cells[board->cols*r + c] ;
-                    if (cell == EMPTY) break ;
+                    if (cell == EMPTY || cell == VALID) break ;
                     if (cell == player)
                         {
                         *pcell = VALID ;
@@ -378,6 +580,7 @@ static BOOL FindMoves(BOARD *board, int player)
         }
 
     return hasMoves ; 
+#endif
     }
 
 static void InitializeTouchScreen(void)
@@ -484,12 +687,39 @@ static void DrawPiece(BOARD *board, int row, int col, int owner)
 
 static void MakeMove(BOARD *board, int cell, int player)
     {
-    int opponent ;
+#ifdef BITBOARD
+    BITS *own = &board->discs[SIDE(player)] ;
+    BITS *opp = &board->discs[1 - SIDE(player)] ;
+    BITS flips = BitFlips(*own, *opp, cell) ;
+    int count = DISCS(flips) ;
+
+    *own |= flips | CELL_BIT(cell) ;
+    *opp &= ~flips ;
+
+    Occupy(board, cell, player) ;
+    board->count[SIDE(player)]   += count ;
+    board->count[1 - SIDE(player)] -= count ;
+    for (; flips != 0; flips &= flips - 1)
+        {
+        int flipped = __builtin_ctzll(flips) ;
+
+        board->cells[flipped] = player ;
+#ifndef SEARCH
+        undo.cells[undo.top++] = flipped ;
+#endif
+        }
+#ifndef SEARCH
+    undo.cells[undo.top++] = count ;
+    undo.cells[undo.top++] = cell ;
+#endif
+#else
+    int opponent, first, count ;
     int row, drow ;
 
     opponent = (player == HUMAN) ? COMPUTER : HUMAN ;
+    first = undo.top ;
 
-    board->cells[cell] = player ;
+    Occupy(board, cell, player) ;
 
     row = cell / board->cols - 1 ;
     for (drow = -1; drow <= 1; drow++, row++)
@@ -526,6 +756,7 @@ static void MakeMove(BOARD *board, int cell, int player)
                             pcell -= board->cols*drow + dcol ;
                             if (*pcell != opponent) break ;
                             *pcell = player ;
+                            undo.cells[undo.top++] = pcell - board->cells ;
                             }
                         break ;
                         } 
@@ -533,6 +764,85 @@ static void MakeMove(BOARD *board, int cell, int player)
                 }
             }
         }
+
+    count = undo.top - first ;
+    board->count[SIDE(player)]   += count ;
+    board->count[SIDE(opponent)] -= count ;
+    undo.cells[undo.top++] = count ;
+    undo.cells[undo.top++] = cell ;
+#endif
+    }
+
+#ifndef SEARCH
+// Takes back the latest move that MakeMove made and has not been taken
+// back. The cell moved to is left EMPTY, even if it was marked VALID.
+static void UnmakeMove(BOARD *board)
+    {
+    int cell, flips, player, opponent ;
+
+    cell  = undo.cells[--undo.top] ;
+    flips = undo.cells[--undo.top] ;
+    player = board->cells[cell] ;
+    opponent = (player == HUMAN) ? COMPUTER : HUMAN ;
+
+    Vacate(board, cell) ;
+#ifdef BITBOARD
+    board->discs[SIDE(player)] &= ~CELL_BIT(cell) ;
+#endif
+    board->count[SIDE(player)]   -= flips ;
+    board->count[SIDE(opponent)] += flips ;
+    while (flips-- != 0)
+        {
+        int flipped = undo.cells[--undo.top] ;
+
+        board->cells[flipped] = opponent ;
+#ifdef BITBOARD
+        board->discs[SIDE(player)]   &= ~CELL_BIT(flipped) ;
+        board->discs[SIDE(opponent)] |=  CELL_BIT(flipped) ;
+#endif
+        }
+    }
+#endif
+
+// Puts a disc on an empty cell, taking the cell off the empty list.
+static void Occupy(BOARD *board, int cell, int who)
+    {
+    int last = board->empty[--board->empties] ;
+
+    board->empty[board->slot[cell]] = last ;
+    board->slot[last] = board->slot[cell] ;
+    board->cells[cell] = who ;
+    board->count[SIDE(who)]++ ;
+    AddNeighbors(board, cell, +1) ;
+    }
+
+#ifndef SEARCH
+// Takes the disc off a cell and puts the cell back on the empty list.
+static void Vacate(BOARD *board, int cell)
+    {
+    board->count[SIDE(board->cells[cell])]-- ;
+    board->slot[cell] = board->empties ;
+    board->empty[board->empties++] = cell ;
+    board->cells[cell] = EMPTY ;
+    AddNeighbors(board, cell, -1) ;
+    }
+#endif
+
+// Adds delta to the neighbor counts around a cell. Its own count changes
+// too, but is only read while the cell is empty.
+static void AddNeighbors(BOARD *board, int cell, int delta)
+    {
+    int row = cell / board->cols ;
+    int col = cell % board->cols ;
+
+    for (int r = row - 1; r <= row + 1; r++)
+        {
+        if (!Between(0, r, board->rows - 1)) continue ;
+        for (int c = col - 1; c <= col + 1; c++)
+            {
+            if (Between(0, c, board->cols - 1)) board->neighbors[board->cols*r + c] += delta ;
+            }
+        }
     }
 
 static int Cells(BOARD *board)
@@ -540,3 +850,337 @@ static int Cells(BOARD *board)
     return board->rows * board->cols ;
     }
 
+#ifdef BITBOARD
+// The empty cells where own can move: those one step beyond a line of
+// opp's discs that starts at one of own's, in any direction.
+static BITS BitMoves(BITS own, BITS opp)
+    {
+    BITS empty = ~(own | opp) ;
+    BITS moves = 0 ;
+
+    for (int d = 0; d < (int) ENTRIES(directions); d++)
+        {
+        moves |= Step(Occluded(own, opp, &directions[d]) & opp, &directions[d]) ;
+        }
+    return moves & empty ;
+    }
+
+// The discs of opp that own's move to cell flips: in each direction, the
+// line of opp's discs from cell on, if one of own's discs ends it.
+static BITS BitFlips(BITS own, BITS opp, int cell)
+    {
+    BITS flips = 0 ;
+
+    for (int d = 0; d < (int) ENTRIES(directions); d++)
+        {
+        BITS line = Occluded(CELL_BIT(cell), opp, &directions[d]) ;
+
+        if (Step(line, &directions[d]) & own) flips |= line & opp ;
+        }
+    return flips ;
+    }
+
+// Kogge-Stone fill: gen together with every cell reached from it by steps
+// in one direction through pro (the propagators), in three rounds of
+// doubling that cover the longest line of six.
+static BITS Occluded(BITS gen, BITS pro, const DIRECTION *dir)
+    {
+    pro &= dir->mask ;
+    gen |= pro & Shift(gen, dir->shift) ;
+    pro &= Shift(pro, dir->shift) ;
+    gen |= pro & Shift(gen, 2*dir->shift) ;
+    pro &= Shift(pro, 2*dir->shift) ;
+    gen |= pro & Shift(gen, 4*dir->shift) ;
+    return gen ;
+    }
+
+static BITS Shift(BITS bits, int shift)
+    {
+    return (shift > 0) ? bits << shift : bits >> -shift ;
+    }
+
+static BITS Step(BITS bits, const DIRECTION *dir)
+    {
+    return Shift(bits, dir->shift) & dir->mask ;
+    }
+
+static BITS CellsToBits(BOARD *board, int who)
+    {
+    BITS bits = 0 ;
+
+    for (int cell = 0; cell < Cells(board); cell++)
+        {
+        if (board->cells[cell] == who) bits |= CELL_BIT(cell) ;
+        }
+    return bits ;
+    }
+
+// Marks the given moves VALID in cells[] and the other empty cells EMPTY.
+static void BitsToCells(BOARD *board, BITS valid)
+    {
+    // MakeMove keeps the discs in cells[] up to date.
+    for (int i = 0; i < board->empties; i++)
+        {
+        int cell = board->empty[i] ;
+
+        board->cells[cell] = (valid & CELL_BIT(cell)) ? VALID : EMPTY ;
+        }
+    }
+#endif
+
+#ifdef SEARCH
+// Iterative deepening: searches one ply deeper each time, with the best
+// move so far tried first, until the game's end is within reach or the
+// time is up. An iteration cut short is thrown away, except the first,
+// which always completes. Shows the depth reached, the node rate and how
+// often the transposition table knew the position.
+static int SearchMove(BOARD *board, int player)
+    {
+    POSITION root, next ;
+    uint8_t order[64] ;
+    int count, empties, move ;
+    uint32_t start, cycles, probes ;
+    char text[100] ;
+
+    root.own  = board->discs[SIDE(player)] ;
+    root.opp  = board->discs[1 - SIDE(player)] ;
+    root.side = SIDE(player) ;
+    root.hash = HashPosition(&root) ;
+    count = OrderMoves(BitMoves(root.own, root.opp), PASS, order) ;
+
+    start = GetClockCycleCount() ;
+    search.deadline = start + SEARCH_MSEC * 1000 * CPU_CLOCK_SPEED_MHZ ;
+    search.stopped = FALSE ;
+    search.depth = 0 ;
+    search.nodes = 0 ;
+    search.hits = 0 ;
+    search.misses = 0 ;
+    search.age++ ;
+    empties = board->empties ;
+    for (int depth = 1; depth <= empties && !search.stopped; depth++)
+        {
+        int alpha = -SCORE_INFINITE, best = 0 ;
+
+        for (int i = 0; i < count; i++)
+            {
+            int score ;
+
+            PlayMove(&root, order[i], &next) ;
+            score = -Negamax(&next, depth - 1, -SCORE_INFINITE, -alpha) ;
+            if (search.stopped) break ;
+            if (score > alpha)
+                {
+                alpha = score ;
+                best = i ;
+                }
+            }
+        if (search.stopped) break ;
+
+        // The best move goes first, the rest keep their order.
+        move = order[best] ;
+        memmove(&order[1], &order[0], best * sizeof(order[0])) ;
+        order[0] = move ;
+        search.depth = depth ;
+        }
+
+    cycles = GetClockCycleCount() - start ;
+    probes = search.hits + search.misses ;
+    sprintf(text, "d%d %lu nodes %luK/s TT %lu%%", search.depth, (unsigned long) search.nodes,
+        (unsigned long) (search.nodes * (uint64_t) CPU_CLOCK_SPEED_MHZ * 1000 / (cycles + 1)),
+        (unsigned long) (probes != 0 ? search.hits * (uint64_t) 100 / probes : 0)) ;
+    DisplayFooter(text) ;
+    return order[0] ;
+    }
+
+// Alpha-beta negamax: the score of the position for the side to move,
+// within [alpha, beta]. A side without a move passes; when neither has one
+// the game is over and the score is the final disc difference.
+static int Negamax(const POSITION *pos, int depth, int alpha, int beta)
+    {
+    BITS moves = BitMoves(pos->own, pos->opp) ;
+    TABLE_ENTRY *entry ;
+    POSITION next ;
+    uint8_t order[64] ;
+    int count, bound, best ;
+
+    if ((++search.nodes & 1023) == 0 && search.depth > 0
+        && (int32_t) (GetClockCycleCount() - search.deadline) > 0) search.stopped = TRUE ;
+    if (search.stopped) return 0 ;
+
+    if (moves == 0)
+        {
+        if (BitMoves(pos->opp, pos->own) == 0) return SCORE_DISC * (DISCS(pos->own) - DISCS(pos->opp)) ;
+        PlayMove(pos, PASS, &next) ;
+        return -Negamax(&next, depth, -beta, -alpha) ;
+        }
+    if (depth == 0) return Evaluate(pos->own, pos->opp, moves) ;
+
+    // A result from a search at least as deep settles the position if it
+    // is exact or its bound falls outside the window. Any other result
+    // still gives the move to try first.
+    best = PASS ;
+    entry = ProbeTable(pos->hash) ;
+    if (entry != NULL)
+        {
+        if (entry->depth >= depth)
+            {
+            if (entry->bound == TT_EXACT) return entry->score ;
+            if (entry->bound == TT_LOWER && entry->score >= beta) return entry->score ;
+            if (entry->bound == TT_UPPER && entry->score <= alpha) return entry->score ;
+            }
+        best = entry->move ;
+        }
+
+    count = OrderMoves(moves, best, order) ;
+    bound = TT_UPPER ;
+    best = order[0] ;
+    for (int i = 0; i < count; i++)
+        {
+        int score ;
+
+        PlayMove(pos, order[i], &next) ;
+        score = -Negamax(&next, depth - 1, -beta, -alpha) ;
+        if (score > alpha)
+            {
+            alpha = score ;
+            best = order[i] ;
+            bound = TT_EXACT ;
+            if (alpha >= beta)
+                {
+                bound = TT_LOWER ;
+                break ;
+                }
+            }
+        }
+
+    if (!search.stopped) StoreTable(pos->hash, depth, bound, alpha, best) ;
+    return alpha ;
+    }
+
+// Lists the moves in the order to try them: first (unless it is PASS or
+// not a move), then group by group as in move_order[]. Returns how many.
+static int OrderMoves(BITS moves, int first, uint8_t order[])
+    {
+    int count = 0 ;
+
+    if (first != PASS && (moves & CELL_BIT(first)) != 0)
+        {
+        order[count++] = first ;
+        moves &= ~CELL_BIT(first) ;
+        }
+    for (int group = 0; group < (int) ENTRIES(move_order); group++)
+        {
+        for (BITS m = moves & move_order[group]; m != 0; m &= m - 1) order[count++] = __builtin_ctzll(m) ;
+        }
+    return count ;
+    }
+
+// Makes a move for the side to move, or passes, and updates the hash for
+// the disc placed, the discs flipped and the turn.
+static void PlayMove(const POSITION *pos, int cell, POSITION *next)
+    {
+    BITS flips ;
+
+    next->own  = pos->opp ;
+    next->opp  = pos->own ;
+    next->side = 1 - pos->side ;
+    next->hash = pos->hash ^ zobrist_turn ;
+    if (cell == PASS) return ;
+
+    flips = BitFlips(pos->own, pos->opp, cell) ;
+    next->own &= ~flips ;
+    next->opp |= flips | CELL_BIT(cell) ;
+    next->hash ^= zobrist[pos->side][cell] ;
+    for (; flips != 0; flips &= flips - 1)
+        {
+        int flipped = __builtin_ctzll(flips) ;
+
+        next->hash ^= zobrist[0][flipped] ^ zobrist[1][flipped] ;
+        }
+    }
+
+// The hash of a position from scratch, for the root of a search.
+static uint64_t HashPosition(const POSITION *pos)
+    {
+    uint64_t hash = (pos->side == SIDE(HUMAN)) ? zobrist_turn : 0 ;
+
+    for (BITS b = pos->own; b != 0; b &= b - 1) hash ^= zobrist[pos->side][__builtin_ctzll(b)] ;
+    for (BITS b = pos->opp; b != 0; b &= b - 1) hash ^= zobrist[1 - pos->side][__builtin_ctzll(b)] ;
+    return hash ;
+    }
+
+static void InitializeSearch(void)
+    {
+    for (int side = 0; side < 2; side++)
+        {
+        for (int cell = 0; cell < (int) ENTRIES(zobrist[0]); cell++)
+            {
+            zobrist[side][cell] = (uint64_t) GetRandomNumber() << 32 | GetRandomNumber() ;
+            }
+        }
+    zobrist_turn = (uint64_t) GetRandomNumber() << 32 | GetRandomNumber() ;
+    }
+
+// Returns the position's entry, or NULL if neither of its bucket's has it.
+static TABLE_ENTRY *ProbeTable(uint64_t hash)
+    {
+    TABLE_ENTRY *bucket = table[hash % TABLE_BUCKETS] ;
+    uint32_t lock = (uint32_t) (hash >> 32) ;
+
+    for (int i = 0; i < 2; i++)
+        {
+        if (bucket[i].depth != 0 && bucket[i].lock == lock)
+            {
+            search.hits++ ;
+            return &bucket[i] ;
+            }
+        }
+    search.misses++ ;
+    return NULL ;
+    }
+
+// A bucket's first entry keeps the deepest result of this move's search,
+// its second the latest of the rest: deep results save the most work, and
+// recent ones are the likeliest to be looked up again. A position already
+// in either entry is updated where it is, so it is never held twice.
+static void StoreTable(uint64_t hash, int depth, int bound, int score, int move)
+    {
+    TABLE_ENTRY *bucket = table[hash % TABLE_BUCKETS] ;
+    TABLE_ENTRY *entry = &bucket[1] ;
+    uint32_t lock = (uint32_t) (hash >> 32) ;
+
+    if (bucket[0].depth != 0 && bucket[0].lock == lock)
+        {
+        entry = &bucket[0] ;
+        }
+    else if (bucket[1].depth != 0 && bucket[1].lock == lock)
+        {
+        entry = &bucket[1] ;
+        }
+    else if (bucket[0].age != (search.age & 3) || depth >= bucket[0].depth)
+        {
+        entry = &bucket[0] ;
+        }
+    entry->lock  = lock ;
+    entry->score = score ;
+    entry->depth = depth ;
+    entry->bound = bound ;
+    entry->move  = move ;
+    entry->age   = search.age & 3 ;
+    }
+
+// Corners are worth having and the squares next to them worth avoiding,
+// and so is leaving the opponent fewer moves than oneself.
+static int Evaluate(BITS own, BITS opp, BITS moves)
+    {
+    int score ;
+
+    score  = 25 * (DISCS(own & CORNERS)   - DISCS(opp & CORNERS)) ;
+    score -= 10 * (DISCS(own & X_SQUARES) - DISCS(opp & X_SQUARES)) ;
+    score -=  4 * (DISCS(own & C_SQUARES) - DISCS(opp & C_SQUARES)) ;
+    score +=  2 * (DISCS(own & EDGES)     - DISCS(opp & EDGES)) ;
+    score +=  3 * (DISCS(moves)           - DISCS(BitMoves(opp, own))) ;
+    return score ;
+    }
+#endif
+